@@ -1,29 +1,26 @@
-// g++ FirstStep.cpp -o FirstStep -I/usr/local/include/opencv -I/usr/local/include -L/usr/local/lib -lopencv_calib3d -lopencv_highgui -lopencv_imgcodecs -lopencv_imgproc -lopencv_core
+// g++ FirstStep.cpp -o FirstStep -pthread -I/usr/local/include/opencv -I/usr/local/include -L/usr/local/lib -lopencv_calib3d -lopencv_highgui -lopencv_imgcodecs -lopencv_imgproc -lopencv_core
 
 #include <iostream>
 #include <fstream>
-#include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/highgui.hpp>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include "platedetection.hpp"
+#include "trace.hpp"
 
 using namespace cv;
 using namespace std;
 
-// detect the license plate in the source image
-void getFirstCut(Mat src, Mat &dst, RotatedRect &cropped_plate);
+// print the latency of the plate detection and append it to temp/speculation.csv, with or without speculation
+// (one line per image, to compare the two modes on the images of each camera)
+// first_ms and alternative_ms are the wall-clock times spent in each detector (alternative_ms is 0 if it did not run),
+// detection_ms the wall-clock time from the start of the detection to the result used
+void reportDetection(const char* src_path, bool speculate, bool first_found, double first_ms, double alternative_ms, double detection_ms);
 
-// if not found with the getFirstCut function, apply a different method to detect the license plate
-void getAlternativeFirstCut(Mat src, Mat &dst, RotatedRect &cropped_plate);
-
-// refine the previously found license plate, removing noise
-void refineCut(Mat src, Mat &dst);
-
-// find and save the license plate keys (in order to be used by the python script)
-void findKeys(Mat src);
-
-// crop function:
-// mode 0: crop the specified area, considering the largest side as the width
-// mode 1: crop the specified area, considering the largest side as the height
-void crop(Mat src, Mat &crop, RotatedRect rect, int mode); 
+// value quoted for a CSV file: the quotes inside it are doubled
+string csvField(const string &value);
 
 // main function
 int main(int argc, char** argv) {
@@ -35,26 +32,126 @@ int main(int argc, char** argv) {
 		cout << "Exiting..." << endl;
 		exit(1);
 	}
-	
+
+	// optional tracing spans (see spans.h), enabled by setting ALPR_SPANS to the path of the JSON file
+	spansStart(getenv("ALPR_SPANS"));
+
+	// optional trace log of the intermediate results (see trace.h), enabled by setting ALPR_TRACE to the log path
+	TraceRecorder trace(getenv("ALPR_TRACE"));
+	trace.beginFrame(argv[1]);
+	vector<RotatedRect> candidates;		// rects which passed the size filters, only stored if tracing
+	int64 start;						// used to time the stages
+
 	Mat license_plate;			// where to save the cropped license plate detected from src
 	RotatedRect cropped_plate;	// where to save the rect containing the license plate detected
 
-	// detect license plate
-	getFirstCut(src, license_plate, cropped_plate);
-	
+	// detect license plate on the level of the image pyramid for which the detectors are tuned
+	// (the level has its own timing: the timings of the detectors cover only the detectors, as in Replay)
+	start = getTickCount();
+	Mat level;
+	double scale = getPyramidLevel(src, level);
+	Mat gray;		// grayscale level, shared by the two detectors
+	cvtColor(level, gray, CV_BGR2GRAY);
+	trace.timing(STAGE_LEVEL, elapsedMs(start));
+	// the level itself is recorded only if ALPR_TRACE_INPUT is set: it allows to replay the detectors without the source image
+	trace.level(scale, getenv("ALPR_TRACE_INPUT") != NULL ? gray : Mat());
+
+	// optional speculative execution, enabled by setting ALPR_SPECULATE to 1:
+	// the alternative detector runs in another thread together with getFirstCut, and it is cancelled
+	// as soon as getFirstCut finds the plate --> no waiting for both detectors when the first one fails
+	bool speculate = getenv("ALPR_SPECULATE") != NULL && atoi(getenv("ALPR_SPECULATE")) != 0;
+	atomic<bool> cancel(false);				// set when the result of the alternative detector is not needed
+	// plate crop on a reduced level: not needed, the plate is cropped from src after the refinement
+	Mat crop_src = scale < 1 ? Mat() : level;
+	Mat alternative_plate;					// results of the alternative detector
+	RotatedRect alternative_rect;
+	bool alternative_found = false;
+	vector<RotatedRect> alternative_candidates;
+	double alternative_ms = 0;				// time spent in the alternative detector
+	int64 detection_start = getTickCount();	// latency of the detection, logged with and without speculation
+	double detection_ms;
+	thread fallback;
+	if (speculate) {
+		fallback = thread([&]() {
+			int64 begin = getTickCount();
+			alternative_found = getAlternativeFirstCut(crop_src, gray, alternative_plate, alternative_rect, trace.enabled() ? &alternative_candidates : NULL, &cancel);
+			alternative_ms = elapsedMs(begin);
+		});
+	}
+
+	start = getTickCount();
+	bool found = getFirstCut(crop_src, gray, license_plate, cropped_plate, trace.enabled() ? &candidates : NULL);
+	double first_ms = elapsedMs(start);
+	if (found) {
+		cancel.store(true);		// plate found: the alternative detector can stop
+	}
+	// the detectors are timed only when they run alone: together they compete for the CPU,
+	// and their timings could not be compared with the replayed ones
+	if (!speculate) {
+		trace.timing(STAGE_FIRST_CUT, first_ms);
+	}
+	for (size_t i = 0; i < candidates.size(); i++) {	// candidates are recorded in src coordinates
+		candidates[i] = scaleRect(candidates[i], 1/scale);
+	}
+	trace.candidates(STAGE_FIRST_CUT, candidates);
+	int plate_stage = STAGE_FIRST_CUT;
+
 	// if no license plate is found:
-	if (license_plate.rows < 1) {
+	if (!found) {
 		cout << "No license plate found: trying alternative method:" << endl;
-		getAlternativeFirstCut(src, license_plate, cropped_plate); // try again to detect the plate
-		if (license_plate.rows < 1) {
+		candidates.clear();
+		if (speculate) {	// already running: wait for its result
+			fallback.join();
+			found = alternative_found;
+			license_plate = alternative_plate;
+			cropped_plate = alternative_rect;
+			candidates = alternative_candidates;
+		} else {
+			start = getTickCount();
+			found = getAlternativeFirstCut(crop_src, gray, license_plate, cropped_plate, trace.enabled() ? &candidates : NULL); // try again to detect the plate
+			alternative_ms = elapsedMs(start);
+		}
+		detection_ms = elapsedMs(detection_start);
+		if (!speculate) {
+			trace.timing(STAGE_ALTERNATIVE_FIRST_CUT, alternative_ms);
+		}
+		for (size_t i = 0; i < candidates.size(); i++) {
+			candidates[i] = scaleRect(candidates[i], 1/scale);
+		}
+		trace.candidates(STAGE_ALTERNATIVE_FIRST_CUT, candidates);
+		plate_stage = STAGE_ALTERNATIVE_FIRST_CUT;
+		reportDetection(argv[1], speculate, false, first_ms, alternative_ms, detection_ms);
+		if (!found) {
 			cout << "No license plate found." << endl << endl;
 			cout << "Exiting..." << endl;
+			trace.endFrame();
 			exit(1);
 		}
+	} else {
+		detection_ms = elapsedMs(detection_start);	// the plate can be used now: the cancelled detector is not waited for
+		if (speculate) {
+			fallback.join();	// returns quickly: the alternative detector has been cancelled
+		}
+		reportDetection(argv[1], speculate, true, first_ms, alternative_ms, detection_ms);
+	}
+
+	// plate found on a reduced level: crop it from src as the detector which found it does at full resolution
+	if (scale < 1) {
+		if (plate_stage == STAGE_FIRST_CUT) {
+			// refine it inside a small window of src, then crop it straightened
+			cropped_plate = refineAtFullResolution(src, cropped_plate, scale);
+			crop(src, license_plate, cropped_plate, 0);
+		} else {
+			// the widened axis-aligned box of getAlternativeFirstCut, mapped to src
+			license_plate = src(alternativeCropBox(cropped_plate, gray.size(), scale) & Rect(0, 0, src.cols, src.rows));
+			cropped_plate = scaleRect(cropped_plate, 1/scale);
+		}
 	}
+	trace.plate(plate_stage, cropped_plate);
+	spansPoll();
 
 	// saving the rect corners in a .txt file, in order to pass it later to the last script
-	Point2f rect_points[4]; 
+	Point2f rect_points[4];
 	cropped_plate.points( rect_points );	// get the corner points from cropped_plate
 	ofstream myfile;
 	myfile.open ("temp/rect.txt");
@@ -65,404 +162,97 @@ int main(int argc, char** argv) {
 	myfile.close();
 
 	// resizing image: licence plate has an average ratio of 4:1
-	resize(license_plate, license_plate, Size(600,150));	
+	resize(license_plate, license_plate, Size(600,150));
+	trace.image(IMAGE_PLATE, license_plate);
 
 	// refine the license plate detected:
-	Mat refined;	
+	Mat refined;
+	start = getTickCount();
 	refineCut(license_plate, refined);
+	trace.timing(STAGE_REFINE_CUT, elapsedMs(start));
 
 	if (refined.rows < 1) {
 		cout << "No possible refinement." << endl;
 		refined = license_plate.clone();
 	}
-
-	// find the plate keys, saving them in the folder 'keys'
-	// the key images will be used in the python script
-	findKeys(refined);
-
-	return 0;
-}
-
-// UTILITY FUNCTIONS
-
-void getFirstCut(Mat src, Mat &dst, RotatedRect &cropped_plate) {
-	
-	// grayscale image
-	Mat gray;
-	cvtColor(src, gray, CV_BGR2GRAY);
-
-	// apply a median filter to the grayscale image
-	// median filter --> preserves edges while removing noise
-	Mat median;
-	medianBlur(gray, median, 1);
-
-	// threshold to have binary image
-	adaptiveThreshold(median, median, 255, CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY, 55, 5);
-
-	// apply open morphological operator to further remove noise
-	// open --> erode followed by dilate
-	Mat element = getStructuringElement( MORPH_RECT, Size(2, 2));
-	morphologyEx(median, median, MORPH_OPEN, element);
-
-	// finding contours and rectangles around it
-	vector<vector<Point> > contours;	// store contours found
-	vector<Vec4i> hierarchy;			// store hierarchies of contours
-	findContours(median, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE); 	// RETR_TREE -> retrieves all the contours and creates a full family hierarchy list
-																				// CHAIN_APPROX_SIMPLE -> saving only the corners of the contours
-
-	// min rectangles around contours
-	vector<RotatedRect> minRect( contours.size() );
-	for( int i = 0; i < contours.size(); i++ ) { 
-	 	minRect[i] = minAreaRect( Mat(contours[i]) );
-	}
-
-	// iterate through the contours
-	for( int i = 0; i < contours.size(); i++ ) {
-
-		// this code needs to fix the angle problem of the rectangles
-		float height = minRect[i].size.height;
-		float width = minRect[i].size.width;
-		float angle = minRect[i].angle;
-		// we need rectangles with width larger than height --> searching license plates
-		if (height > width) {	// switch sizes if height > width
-			float temp = width;
-			width = height;
-			height = temp;
-		} 
-		float ratio = width/height; // useful to detect the right rectangle containing the license plate
-		
-		// the following if statement filters out lots of rectangles --> rectangles which cannot be licence plates
-		if (ratio > 1.8 && ratio < 6 && height > 20 && width > 90 && height < 90) {	
-   		
-	   		int counter = 0;			// number of "key" rectangles found inside the current rectangle
-	   		int k = hierarchy[i][2];	// searching through the children of the current rectangle
-	   		if (k > 0) {				// current rectangle has children (at least 1 child)
-	   			do {
-	   				Rect rex = boundingRect(contours.at(k));	// rectangle bounding a contour
-	   				// the following if statement filters out rectangles which cannot be plate keys
-	   				if (rex.width > 10 && rex.height > 10 && (float)rex.width/rex.height < 0.75 && (float)rex.width/rex.height > 0.3) {
-	   					counter++;
-	   				}
-	   				k = hierarchy[k][0]; // next rectangle in the same layes
-	   			} while (k>0);
-	   		}
-	   		if (counter > 4) {	// requirement: a license plate has at least 5 plate keys
-	   			cropped_plate = minRect[i];
-				crop(src, dst, minRect[i], 0);
-				// it is not needed to go further --> it is unlikely this is not the license plate
-				return;
-	   		}
-	   	} 
-	}
-}
-
-void getAlternativeFirstCut(Mat src, Mat &dst, RotatedRect &cropped_plate) {
-	
-	// grayscale image
-	Mat gray;
-	cvtColor(src, gray, CV_BGR2GRAY);
-
-	// filtered grayscale image
-	// using gaussian blur filter --> to reduce noise 
-	Mat gaussian;
-	GaussianBlur( gray, gaussian, Size(5, 5), 0);
-
-	// filtering using sobel filter to emphasize edges
-	// in this case: sobel used to detect vertical edges.
-	Mat sobel;
-	Sobel( gaussian, sobel, -1, 1, 0 );
-
-	// threshold to have binary image
-	threshold(sobel, sobel, 80, 255, THRESH_BINARY);
-
-	// applying morpological operator close --> to better define the plate zone
-	// close: first dilate then erode
-	// useful to close small holes inside the objects
-	Mat morph;
-	Mat element = getStructuringElement( MORPH_RECT, Size(16, 16));
-	morphologyEx(sobel, morph, MORPH_CLOSE, element);
-
-	// finding contours and rectangles around them
-	vector<vector<Point> > contours;	// store contours found
-	vector<Vec4i> hierarchy;			// store hierarchies of contours
-	findContours(morph, contours, hierarchy, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);	// RETR_EXTERNAL ->  all child contours left behind
-																					// CHAIN_APPROX_SIMPLE -> saving only the corners of the contours
-	// min rectangle around contours
-	vector<RotatedRect> minRect( contours.size() );	
-	for( int i = 0; i < contours.size(); i++ ) { 
-		minRect[i] = minAreaRect( Mat(contours[i]) );
-	}
-
-	int index = -1;				// index of the candidate rectangle
-	float edge_density = 0;		// to filter out all the noise given by rectangles which are not the license plate
-	Rect box(0,0,1,1);			// roi used later to crop the plate from the src; it will be updated
-	
-	for( int i = 0; i < contours.size(); i++ ) {	// iterate through the contours
-		// this code needs to fix the angle problem of the rects
-		float height = minRect[i].size.height;
-		float width = minRect[i].size.width;
-		// we need rectangles with width larger than height --> searching license plates
-		if (height > width) {	// switch sizes if height > width
-			float temp = width;
-			width = height;
-			height = temp;
-		} 
-		float ratio = width/height; // useful to detect the right rectangle containing the license plate
-
-		Point2f center = minRect[i].center;		// center of the rectangle
-		
-		// the following if statement filters out lots of rectangles --> rectangles which cannot be licence plates
-		if ((ratio < 1.5 || ratio > 5 || width < 30 || height < 16)) {
-			// skip
-	   	} else {
-	   		// rotated rectangle
-			Point2f rect_points[4]; 
-			minRect[i].points( rect_points );
-	   		// building roi to crop
-	   		Rect roi;
-	   		if (width < 1 || height < 1) {continue;}
-	   		roi.x = minRect[i].center.x-width/2;
-	   		if (roi.x < 0) { roi.x = 0; }	// check if roi is inside the image
-			roi.y = minRect[i].center.y-height/2;
-	   		if (roi.y < 0) { roi.y = 0; }	// check if roi is inside the image
-	   		if (roi.x + width > src.cols) { roi.width = src.cols-roi.x; }	// check if roi is inside the image
-	   		else { roi.width = width; }
-	   		if (roi.y + height > src.rows) { roi.height = src.rows-roi.y; }	// check if roi is inside the image
-	   		else { roi.height = height; }
-
-	   		// compute the edge_density (white pixels) inside each rect which survived so far
-	   		Mat crop = morph(roi);
-	   		int white = 0;		// number of white pixels
-	   		int count = 0;		// total number of pixels
-	   		for (int k = 0; k < crop.rows; k++) {
-	   			for (int m = 0; m < crop.cols; m++) {
-	   				if (crop.at<uchar>(k,m) > 250) { white++; }
-	   				count++;
-	   			}
-	   		}
-
-	   		// edge density of the current rectangle
-	   		float density = (float)white/count;	
-
-	   		// keeping only one rect: the one with the highest density
-	   		if (density > edge_density) {
-	   			edge_density = density;	// max density so far
-	   			index = i;				// updating the index of the candidate
-	   			box = roi;				// storing the roi of the candidate
-	   		} 
-	  	}
-	}
-
-	// increasing the width a bit (12 pixels), in order to be sure to have the license plate
-	// it will be refined later
-	box.width += 12;		
-	if (box.width > src.cols) { 	// check if roi is inside the image
-		box.width = src.cols-box.width;
-	}
-
-	// crop the src image, based on the stored roi
-	dst = src(box);
-	// min rectangle containing the license plate
-	cropped_plate = minRect[index];
-}
-
-void refineCut(Mat src, Mat &dst) {
-	// clone the src, we do not want the source to change
-	Mat plate = src.clone();
-	cvtColor(plate, plate, CV_BGR2GRAY);	// plate in grayscale
-
-	// threshold the grayscale image to get binary image
-	adaptiveThreshold(plate, plate, 255, CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY, 55, 5);
-
-	// getting contours of the cropped images
-	vector<vector<Point>> contours;
-	vector<Vec4i> hierarchy;
-	// find contours of cropped image
-	findContours(plate, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE);	// RETR_TREE -> retrieves all the contours and creates a full family hierarchy list
-																				// CHAIN_APPROX_SIMPLE -> saving only the corners of the contours
-	vector<RotatedRect> rects( contours.size() );	// rectangles around contours
-
-	// find the rect with the biggest dimensions --> in order to crop better the license plate --> further remove noise
-	double max_wid = 0;		// max width of rects
-	double max_hei = 0;		// max height of rects
-	int ind = 0;			// index of biggest rect
-	for( int i = 0; i < contours.size(); i++ ) { 
-	 	rects[i] = minAreaRect( Mat(contours[i]));		// get min area rect around contours
-	 	Point2f pts[4]; 
-	 	rects[i].points( pts );			// points of the rect
-
-		// compute max width and height
-		Size s = rects[i].size;
-		double wid = s.width;			// current width
-		double hei = s.height;			// current height
-		if (hei > wid) {				// fixing the angle problem of rects --> we need width > height
-			float temp = wid;
-			wid = hei;
-			hei = temp;
-		} 
-		// update the index of the biggest square
-		if (wid >= max_wid && hei >= max_hei && hei > 20) {
-			max_wid = wid;
-			max_hei = hei;
-			ind = i;
-		}
-	}
-	
-	// cropping the license plate with better precision, reducing noise
-	crop(src, dst, rects[ind], 0);
 	// save refined license plate image to test keypoints object detection on it
-	stringstream filepath;
-	filepath << "ObjectDetection/license_plate.jpg";
-	string obj_path = filepath.str();
-	imwrite(obj_path, dst);
-}
+	imwrite("ObjectDetection/license_plate.jpg", refined);
+	trace.image(IMAGE_REFINED, refined);
+	spansPoll();
 
-void findKeys(Mat src) {
-	// grayscale plate; src is cloned because we do not want it to change
-	Mat gray_refined = src.clone();
-	cvtColor(src, gray_refined, CV_BGR2GRAY);
-	
-	// threshold to get binary image of plate
-	adaptiveThreshold(gray_refined, gray_refined, 255, CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY, 55, 5);
+	// find the plate keys
+	vector<Mat> keys;
+	start = getTickCount();
+	findKeys(refined, keys);
+	trace.timing(STAGE_FIND_KEYS, elapsedMs(start));
 
-	// find contours inside the detected license plate
-	vector<vector<Point>> contours;
-	vector<Vec4i> hierarchy;
-	// find contours of cropped image
-	findContours(gray_refined, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE);	// RETR_TREE -> retrieves all the contours and creates a full family hierarchy list
-																						// CHAIN_APPROX_SIMPLE -> saving only the corners of the contours
-	vector<RotatedRect> digichar( contours.size() );	// all rectangles around contours
-	for( int i = 0; i < contours.size(); i++ ) { 
-	 	digichar[i] = minAreaRect( Mat(contours[i]));		// get min area rect around contours
-	}
-
-	vector<Mat> keys;			// license plate keys (need to be sorted)
-	vector<double> x_centers;	// x coord of centers of key rectangles	(used to sort keys)
-	// Showing the digichar in the plate
-	for (int i = 0; i < digichar.size(); i++) {
-		Point2f center = digichar[i].center;
-		Size size = digichar[i].size;
-		
-		// in this case we want rectangles to have larger height than width
-		if (size.width > size.height) {
-			size = Size(size.height, size.width);
-		}
-
-		float ratio = (float)size.height/size.width;	// useful information to detect keys of the current rectangle
-
-		// if statements to filter out rectangles that are not plate keys
-		if (size.width <= 25 || size.height <= 75 || size.height > 180) {continue;}
-		if (ratio < 1.25 || ratio > 4.4) {continue;}	
-	
-		// crop candidate key from license plate and store it
-		Mat candidate;		
-		crop(src, candidate, digichar[i], 1);
-		keys.push_back(candidate);
-		x_centers.push_back(center.x);
-	}
-	vector<Mat> sorted_keys;		// used to store sorted keys
-	int iters = keys.size();
 	// if no keys were found --> exit
-	if (x_centers.size() < 1) {
+	if (keys.size() < 1) {
 		cout << "No keys found in detected license plate." << endl;
 		cout << "Ending..." << endl;
+		trace.endFrame();
 		exit(1);
 	}
-	double prev = x_centers.at(0);	// key at previous iteration
-	for (int i = 0; i < iters; i++) {
-		double x = x_centers.at(0);	// always get the first one --> later keys will be removed from here when added to the sorted vector	
-		int index = 0;				// used to sort keys properly
-		// for loop to get next key to add in the sorted vector
-		for (int j = 1; j < x_centers.size(); j++) {
-			double y = x_centers.at(j);
-			if (y < x) {	// keeping track of the most to the left remaining key
-				x = y;
-				index = j;
-			}
-		}
-		if (x < prev+5 && i != 0) {	// this rectangle is inside the previous key --> ignored and removed
-			prev = x; 
-			keys.erase(keys.begin() + index); 
-			x_centers.erase(x_centers.begin() + index);
-		}
-		else {						// add the key in the sorted list, then removed from the keys list
-			Mat temp = keys.at(index);
-			sorted_keys.push_back(temp);
-			keys.erase(keys.begin() + index);
-			x_centers.erase(x_centers.begin() + index);
-			prev = x;
-		}
-	}
-
-	// grayscale license plate image
-	cvtColor(src, src, CV_BGR2GRAY);	
-	double light = 0;	// average pixel value
-	int counter = 0;	// number of pixels
-	// summing up all pixel values of the grayscale license plate and then divide by the total number of pixel
-	// --> to get best possibile value for thresholding
-	for (int i = 0; i < src.cols; i++) {
-		for (int j = 0; j < src.rows; j++) {
-			counter++;
-			light += src.at<uchar>(j,i);
-		}
-	}
-	light /= counter;
-
-	// padding values
-	int top = (int) (0.3*28); 
-	int bottom = (int) (0.3*28);
-	int left = (int) (0.3*28); 
-	int right = (int) (0.3*28);
 
-	// processing of keys
-	// thresholding, resizing and padding the keys --> to better resemble the dataset used to train the CNN
-	for (int i = 0; i < sorted_keys.size(); i++) {
-		Mat temp = sorted_keys.at(i);
-		cvtColor(temp, temp, CV_BGR2GRAY);
-		threshold(temp, temp, light, 255, THRESH_BINARY); 
-		resize(temp, temp, Size(28,28));
-		Mat inverted = ~temp;
-		copyMakeBorder( inverted, inverted, top, bottom, left, right, BORDER_CONSTANT, 0 );
-		resize(inverted, inverted, Size(28,28));
-
-		// Mat element = getStructuringElement( MORPH_RECT, Size(2,2));
-		// erode(inverted, inverted, element);
-
-		// save in the 'keys' folder the processed key images
+	// save in the 'keys' folder the processed key images
+	// the key images will be used in the python script
+	for (size_t i = 0; i < keys.size(); i++) {
+		trace.image(IMAGE_KEY, keys[i]);
 		stringstream filepath;
 		filepath << "keys/" << i+1 << ".jpg";
 		string obj_path = filepath.str();
-		imwrite(obj_path, inverted);
+		imwrite(obj_path, keys[i]);
 	}
+
+	return 0;
 }
 
-void crop(Mat src, Mat &crop, RotatedRect rect, int mode) {
-	// get center, angle and size of rect
-	Point2f center = rect.center;
-	double angle = rect.angle;
-	Size size = rect.size;
-	if (mode == 0) {
-		// we need width > height
-		if (size.height > size.width) {
-			angle += 90;
-			size = Size(size.height, size.width);
-		}
-	} else if (mode == 1) {
-		// we need height > width
-		if (size.width > size.height) {
-			angle += 90;
-			size = Size(size.height, size.width);
+// UTILITY FUNCTIONS
+
+void reportDetection(const char* src_path, bool speculate, bool first_found, double first_ms, double alternative_ms, double detection_ms) {
+	// wall-clock times: the detectors use the worker threads of OpenCV too, so the CPU time of a single thread
+	// would not tell how long they take --> the modes are compared by running both on the images of each camera
+	cout << "Detection " << (speculate ? "with" : "without") << " speculation: " << (first_found ? "first detector" : "alternative detector")
+		<< " used, " << detection_ms << " ms (first detector " << first_ms << " ms, alternative detector " << alternative_ms << " ms)." << endl;
+
+	// camera which took the image, to compare the cameras: ALPR_CAMERA if set, otherwise the folder of the image
+	string path = src_path;
+	string camera;
+	if (getenv("ALPR_CAMERA") != NULL) {
+		camera = getenv("ALPR_CAMERA");
+	} else {
+		size_t slash = path.find_last_of('/');
+		if (slash != string::npos) {
+			camera = path.substr(0, slash);
+			camera = camera.substr(camera.find_last_of('/') + 1);	// whole string if there is no other '/'
 		}
-	} else {	// wrong mode
-		cout << "Wrong 'mode' crop paramter" << endl;
-		cout << "Exiting..." << endl;
-		exit(1);
 	}
 
-	// compute rotation matrix
-	Mat m = getRotationMatrix2D(center, angle, 1);
-	// apply affine transformation
-	warpAffine(src, crop, m, src.size());
-	// retrieve rectangle from an image with sub-pixel accuracy
-	getRectSubPix(crop, size, center, crop);
-}
\ No newline at end of file
+	string header = "camera,image,speculate,first_found,first_ms,alternative_ms,detection_ms";
+	// write the header if the file is new; a file with other columns is kept aside
+	ifstream existing("temp/speculation.csv");
+	string first_line;
+	bool is_new = !getline(existing, first_line);
+	existing.close();
+	if (!is_new && first_line != header) {
+		cout << "temp/speculation.csv has different columns: moved to temp/speculation.old.csv" << endl;
+		rename("temp/speculation.csv", "temp/speculation.old.csv");
+		is_new = true;
+	}
+
+	ofstream csv("temp/speculation.csv", ios::app);
+	if (is_new) {
+		csv << header << endl;
+	}
+	csv << csvField(camera) << "," << csvField(path) << "," << speculate << "," << first_found << ","
+		<< first_ms << "," << alternative_ms << "," << detection_ms << endl;
+}
+
+string csvField(const string &value) {
+	string quoted = "\"";
+	for (size_t i = 0; i < value.size(); i++) {
+		if (value[i] == '"') { quoted += '"'; }
+		quoted += value[i];
+	}
+	return quoted + "\"";
+}
@@ -0,0 +1,100 @@
+// g++ -O2 PyramidBenchmark.cpp -o PyramidBenchmark -I/usr/local/include/opencv -I/usr/local/include -L/usr/local/lib -lopencv_calib3d -lopencv_highgui -lopencv_imgcodecs -lopencv_imgproc -lopencv_core
+
+#include <iostream>
+#include <cstdlib>
+#include "platedetection.hpp"
+#include "trace.hpp"
+
+using namespace cv;
+using namespace std;
+
+// maximum ratio between the mean detection times of the slowest and the fastest sizes: above it the benchmark fails
+// (the detectors run on a level between 640 and 1280 pixels wide, whose area changes with the size of the image)
+#define PYRAMID_MAX_COST_RATIO 3.0
+
+// time spent to detect and crop the plate from src, as FirstStep does (milliseconds)
+// found is set to true if the plate is found
+double detect(Mat src, bool &found, RotatedRect &plate, Size &level_size);
+
+// main function
+// usage: ./PyramidBenchmark <image> [iterations] [max ratio]
+// the image is scaled to 1, 2, 4, 8 and 12 megapixels (plates included) and the plate detection is timed at each size:
+// with the pyramid search its cost should stay nearly constant
+// exit status 1 if the slowest size costs more than the fastest one times the maximum ratio (PYRAMID_MAX_COST_RATIO by default)
+int main(int argc, char** argv) {
+
+	Mat image = imread(argc > 1 ? argv[1] : "");
+	if (image.cols < 1) {
+		cout << "Usage: " << argv[0] << " <image> [iterations] [max ratio]" << endl;
+		cout << "Exiting..." << endl;
+		exit(1);
+	}
+	int iterations = argc > 2 ? atoi(argv[2]) : 10;
+	if (iterations < 1) { iterations = 1; }
+	double max_ratio = argc > 3 ? atof(argv[3]) : PYRAMID_MAX_COST_RATIO;
+
+	double megapixels[] = { 1, 2, 4, 8, 12 };
+	double fastest = -1;	// mean time of the fastest and slowest sizes
+	double slowest = -1;
+	for (int i = 0; i < 5; i++) {
+		// same aspect ratio as the image
+		double factor = sqrt(megapixels[i]*1e6 / ((double) image.cols*image.rows));
+		Mat src;
+		resize(image, src, Size(cvRound(image.cols*factor), cvRound(image.rows*factor)));
+
+		double total = 0;
+		bool found = false;
+		RotatedRect plate;
+		Size level_size;
+		for (int k = 0; k < iterations; k++) {
+			total += detect(src, found, plate, level_size);
+		}
+		double mean = total/iterations;
+		if (fastest < 0 || mean < fastest) { fastest = mean; }
+		if (slowest < 0 || mean > slowest) { slowest = mean; }
+
+		cout << megapixels[i] << " MP (" << src.cols << "x" << src.rows << ", level " << level_size.width << "x" << level_size.height << "): "
+			<< mean << " ms, plate " << (found ? "found" : "not found");
+		if (found) {
+			cout << " (center " << plate.center << ", size " << plate.size << ")";
+		}
+		cout << endl;
+	}
+	cout << "slowest / fastest: " << slowest/fastest << endl;
+
+	if (slowest/fastest > max_ratio) {
+		cout << "FAILED: the cost of the detection changes more than " << max_ratio << " times with the size of the image." << endl;
+		return 1;
+	}
+	cout << "OK: the cost of the detection changes less than " << max_ratio << " times with the size of the image." << endl;
+	return 0;
+}
+
+// UTILITY FUNCTIONS
+
+double detect(Mat src, bool &found, RotatedRect &plate, Size &level_size) {
+	int64 start = getTickCount();
+	Mat level;
+	double scale = getPyramidLevel(src, level);
+	level_size = level.size();
+	Mat gray;
+	cvtColor(level, gray, CV_BGR2GRAY);
+	Mat crop_src = scale < 1 ? Mat() : level;	// the plate is cropped from src when the level is reduced
+	Mat license_plate;
+	bool alternative = false;	// plate found by the alternative detector
+	found = getFirstCut(crop_src, gray, license_plate, plate);
+	if (!found) {
+		found = getAlternativeFirstCut(crop_src, gray, license_plate, plate);
+		alternative = found;
+	}
+	if (found && scale < 1) {
+		if (!alternative) {
+			plate = refineAtFullResolution(src, plate, scale);
+			crop(src, license_plate, plate, 0);
+		} else {
+			license_plate = src(alternativeCropBox(plate, gray.size(), scale) & Rect(0, 0, src.cols, src.rows));
+			plate = scaleRect(plate, 1/scale);
+		}
+	}
+	return elapsedMs(start);
+}
@@ -0,0 +1,396 @@
+// g++ Replay.cpp -o Replay -I/usr/local/include/opencv -I/usr/local/include -L/usr/local/lib -lopencv_calib3d -lopencv_highgui -lopencv_imgcodecs -lopencv_imgproc -lopencv_core
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "platedetection.hpp"
+#include "trace.hpp"
+
+using namespace cv;
+using namespace std;
+
+// print the content of every frame inside the log
+void listFrames(const TraceReader &reader);
+
+// run a single stage of a frame 'iterations' times, printing its timings and comparing its result with the recorded one
+void replayStage(const TraceFrame &frame, int stage, int iterations);
+
+// largest difference allowed between the centers and between the sides of a key found by segmentKeys
+// and the same key found by segmentKeysContours, in pixels: both find the same rect, up to rounding
+#define KEYS_MAX_OFFSET 0.5
+
+// largest mean absolute difference (0-255) allowed between a key prepared by findKeys and the same key prepared
+// by the contour based pipeline: less than a single pixel of the 28x28 image (rounding of the rotation)
+#define KEYS_MAX_DIFFERENCE 0.5
+
+// contour based version of segmentKeys (findContours and a min area rect for each contour), the one used before it
+// kept as reference for keysRegression
+void segmentKeysContours(Mat src, vector<RotatedRect> &rects);
+
+// processing of the keys which used to follow segmentKeysContours: each key cropped from the color plate
+void prepareKeysContours(Mat src, const vector<RotatedRect> &rects, vector<Mat> &keys);
+
+// check that findKeys finds the same keys, in the same order and with the same images (up to rounding),
+// as segmentKeysContours and the previous processing, on the refined plate of every frame
+// returns the number of frames with different keys
+int keysRegression(const TraceReader &reader);
+
+// main function
+// usage: ./Replay <trace file>                                     --> list the recorded frames
+//        ./Replay <trace file> keys-regression                     --> compare the keys of the two segmentations on every frame
+//        ./Replay <trace file> <frame> <stage> [iterations]        --> re-run a single stage of a frame
+// stage: first, alternative, refine or keys
+int main(int argc, char** argv) {
+
+	if (argc < 2) {
+		cout << "Usage: " << argv[0] << " <trace file> [<frame> <stage> [iterations] | keys-regression]" << endl;
+		cout << "Exiting..." << endl;
+		exit(1);
+	}
+
+	// optional tracing spans of the replayed stage (see spans.h)
+	spansStart(getenv("ALPR_SPANS"));
+
+	TraceReader reader(argv[1]);
+	if (argc == 3 && strcmp(argv[2], "keys-regression") == 0) {
+		return keysRegression(reader) > 0 ? 1 : 0;
+	}
+	if (argc < 4) {
+		listFrames(reader);
+		return 0;
+	}
+
+	int index = atoi(argv[2]);
+	if (index < 0 || index >= reader.frames()) {
+		cout << "No frame " << index << " in the trace file: it contains " << reader.frames() << " frames." << endl;
+		cout << "Exiting..." << endl;
+		exit(1);
+	}
+
+	// look for the stage given by name
+	int stage = -1;
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		if (strcmp(argv[3], traceStageName(i)) == 0) {
+			stage = i;
+		}
+	}
+	if (stage < 0) {
+		cout << "Unknown stage '" << argv[3] << "': use level, first, alternative, refine or keys." << endl;
+		cout << "Exiting..." << endl;
+		exit(1);
+	}
+
+	int iterations = argc > 4 ? atoi(argv[4]) : 10;
+	if (iterations < 1) { iterations = 1; }
+
+	replayStage(reader.frame(index), stage, iterations);
+
+	return 0;
+}
+
+// UTILITY FUNCTIONS
+
+void listFrames(const TraceReader &reader) {
+	for (int i = 0; i < reader.frames(); i++) {
+		const TraceFrame &frame = reader.frame(i);
+		cout << i << ": " << frame.src_path << endl;
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			// stage not run for this frame (the detectors can have candidates without timing: speculative run)
+			if (frame.timings[s] < 0 && frame.candidates[s].empty()) { continue; }
+			cout << "\t" << traceStageName(s) << ": ";
+			if (frame.timings[s] < 0) {
+				cout << "not timed";
+			} else {
+				cout << frame.timings[s] << " ms";
+			}
+			if (s == STAGE_FIRST_CUT || s == STAGE_ALTERNATIVE_FIRST_CUT) {
+				cout << ", " << frame.candidates[s].size() << " candidates";
+			}
+			cout << endl;
+		}
+		if (frame.plate_stage >= 0) {
+			cout << "\tplate found by " << traceStageName(frame.plate_stage) << ": center " << frame.plate.center
+				<< ", size " << frame.plate.size << ", angle " << frame.plate.angle << endl;
+		}
+		if (frame.level_img.rows > 0) {
+			cout << "\tdetector input recorded: " << frame.level_img.cols << "x" << frame.level_img.rows << ", scale " << frame.level_scale << endl;
+		}
+		cout << "\t" << frame.keys.size() << " keys";
+		if (frame.probabilities.size() > 0) {
+			cout << ", " << frame.probabilities.size() << " classified";
+		}
+		cout << endl;
+	}
+}
+
+void replayStage(const TraceFrame &frame, int stage, int iterations) {
+	// input of the stage
+	Mat input;
+	bool recorded_level = false;	// the detectors run on the grayscale level stored in the log
+	if (stage == STAGE_FIRST_CUT || stage == STAGE_ALTERNATIVE_FIRST_CUT) {
+		if (frame.level_img.rows > 0) {
+			input = frame.level_img;
+			recorded_level = true;
+		} else {
+			input = imread(frame.src_path);		// level not recorded: the source image is read again
+		}
+	} else if (stage == STAGE_LEVEL) {
+		input = imread(frame.src_path);
+	} else if (stage == STAGE_REFINE_CUT) {
+		input = frame.plate_img;
+	} else {
+		input = frame.refined_img;
+	}
+	if (input.rows < 1) {
+		cout << "The input of stage '" << traceStageName(stage) << "' is not available for this frame." << endl;
+		if (stage == STAGE_FIRST_CUT || stage == STAGE_ALTERNATIVE_FIRST_CUT) {
+			cout << "Record the frames with ALPR_TRACE_INPUT set, or keep the source image at " << frame.src_path << "." << endl;
+		} else if (stage == STAGE_LEVEL) {
+			cout << "Keep the source image at " << frame.src_path << "." << endl;
+		}
+		cout << "Exiting..." << endl;
+		exit(1);
+	}
+
+	// run the stage, keeping the output of the last iteration
+	double total = 0;
+	double best = -1;
+	Mat dst;
+	bool found = false;
+	RotatedRect plate;
+	vector<RotatedRect> candidates;
+	vector<Mat> keys;
+	Mat level;
+	Mat gray;
+	double scale = 1;
+	// the detectors run on the pyramid level, like in FirstStep: it is computed once, outside of the timed runs
+	if (stage == STAGE_FIRST_CUT || stage == STAGE_ALTERNATIVE_FIRST_CUT) {
+		if (recorded_level) {	// the grayscale level is both the image and its grayscale version
+			level = input;
+			gray = input;
+			scale = frame.level_scale;
+		} else {
+			scale = getPyramidLevel(input, level);
+			cvtColor(level, gray, CV_BGR2GRAY);
+		}
+	}
+	for (int i = 0; i < iterations; i++) {
+		candidates.clear();
+		dst = Mat();
+		int64 start = getTickCount();
+		switch (stage) {
+			case STAGE_LEVEL:
+				scale = getPyramidLevel(input, level);
+				cvtColor(level, gray, CV_BGR2GRAY);
+				break;
+			case STAGE_FIRST_CUT:
+			case STAGE_ALTERNATIVE_FIRST_CUT:
+				// like in FirstStep, the plate is cropped from the level only if it is not reduced
+				if (stage == STAGE_FIRST_CUT) {
+					found = getFirstCut(scale < 1 ? Mat() : level, gray, dst, plate, &candidates);
+				} else {
+					found = getAlternativeFirstCut(scale < 1 ? Mat() : level, gray, dst, plate, &candidates);
+				}
+				break;
+			case STAGE_REFINE_CUT: refineCut(input, dst); break;
+			case STAGE_FIND_KEYS: findKeys(input, keys); break;
+		}
+		double ms = elapsedMs(start);
+		total += ms;
+		if (best < 0 || ms < best) { best = ms; }
+	}
+
+	// timings: the recorded one comes from the build which wrote the log
+	cout << "stage " << traceStageName(stage) << ": " << iterations << " iterations, mean " << total/iterations << " ms, min " << best << " ms, ";
+	if (frame.timings[stage] < 0) {
+		cout << "not timed when recorded" << endl;
+	} else {
+		cout << "recorded " << frame.timings[stage] << " ms" << endl;
+	}
+
+	// compare the result with the recorded one
+	if (stage == STAGE_LEVEL) {
+		cout << "level: " << level.cols << "x" << level.rows << ", scale " << scale << " (recorded scale " << frame.level_scale << ")" << endl;
+	} else if (stage == STAGE_FIRST_CUT || stage == STAGE_ALTERNATIVE_FIRST_CUT) {
+		// candidates and plate in src coordinates, as they are recorded
+		for (size_t i = 0; i < candidates.size(); i++) {
+			candidates[i] = scaleRect(candidates[i], 1/scale);
+		}
+		if (found) {
+			// like in FirstStep, only the plates of getFirstCut are refined at full resolution
+			// the refinement needs the source image: with the recorded level the plate is only mapped back
+			bool refine = stage == STAGE_FIRST_CUT && !recorded_level;
+			plate = refine ? refineAtFullResolution(input, plate, scale) : scaleRect(plate, 1/scale);
+		}
+		cout << "candidates: " << candidates.size() << " (recorded " << frame.candidates[stage].size() << ")" << endl;
+		if (!found) {
+			cout << "plate: not found" << (frame.plate_stage == stage ? " (recorded: found)" : "") << endl;
+		} else {
+			cout << "plate: center " << plate.center << ", size " << plate.size << ", angle " << plate.angle;
+			if (frame.plate_stage == stage) {
+				cout << " (recorded: center " << frame.plate.center << ", size " << frame.plate.size << ", angle " << frame.plate.angle << ")";
+			}
+			cout << endl;
+		}
+	} else if (stage == STAGE_REFINE_CUT) {
+		cout << "refined plate: " << dst.cols << "x" << dst.rows;
+		if (frame.refined_img.rows > 0) {
+			cout << " (recorded " << frame.refined_img.cols << "x" << frame.refined_img.rows << ")";
+		}
+		cout << endl;
+	} else {
+		int same = 0;	// keys identical to the recorded ones
+		for (size_t i = 0; i < keys.size() && i < frame.keys.size(); i++) {
+			if (keys[i].size() == frame.keys[i].size() && norm(keys[i], frame.keys[i], NORM_INF) == 0) {
+				same++;
+			}
+		}
+		cout << "keys: " << keys.size() << " (recorded " << frame.keys.size() << "), " << same << " identical" << endl;
+	}
+}
+
+void segmentKeysContours(Mat src, vector<RotatedRect> &rects) {
+	// grayscale plate; src is cloned because we do not want it to change
+	Mat gray_refined = src.clone();
+	cvtColor(src, gray_refined, CV_BGR2GRAY);
+	
+	// threshold to get binary image of plate
+	adaptiveThreshold(gray_refined, gray_refined, 255, CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY, 55, 5);
+
+	// find contours inside the detected license plate
+	vector<vector<Point>> contours;
+	vector<Vec4i> hierarchy;
+	// find contours of cropped image
+	findContours(gray_refined, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE);	// RETR_TREE -> retrieves all the contours and creates a full family hierarchy list
+																						// CHAIN_APPROX_SIMPLE -> saving only the corners of the contours
+	vector<RotatedRect> digichar( contours.size() );	// all rectangles around contours
+	for( int i = 0; i < contours.size(); i++ ) { 
+	 	digichar[i] = minAreaRect( Mat(contours[i]));		// get min area rect around contours
+	}
+
+	vector<RotatedRect> candidates;	// license plate keys (need to be sorted)
+	vector<double> x_centers;		// x coord of centers of key rectangles	(used to sort keys)
+	// Showing the digichar in the plate
+	for (int i = 0; i < digichar.size(); i++) {
+		Point2f center = digichar[i].center;
+		Size size = digichar[i].size;
+		
+		// in this case we want rectangles to have larger height than width
+		if (size.width > size.height) {
+			size = Size(size.height, size.width);
+		}
+
+		float ratio = (float)size.height/size.width;	// useful information to detect keys of the current rectangle
+
+		// if statements to filter out rectangles that are not plate keys
+		if (size.width <= 25 || size.height <= 75 || size.height > 180) {continue;}
+		if (ratio < 1.25 || ratio > 4.4) {continue;}	
+	
+		candidates.push_back(digichar[i]);
+		x_centers.push_back(center.x);
+	}
+	rects.clear();
+	int iters = candidates.size();
+	// if no keys were found --> nothing to sort
+	if (x_centers.size() < 1) {
+		return;
+	}
+	double prev = x_centers.at(0);	// key at previous iteration
+	for (int i = 0; i < iters; i++) {
+		double x = x_centers.at(0);	// always get the first one --> later keys will be removed from here when added to the sorted vector	
+		int index = 0;				// used to sort keys properly
+		// for loop to get next key to add in the sorted vector
+		for (int j = 1; j < x_centers.size(); j++) {
+			double y = x_centers.at(j);
+			if (y < x) {	// keeping track of the most to the left remaining key
+				x = y;
+				index = j;
+			}
+		}
+		if (x < prev+5 && i != 0) {	// this rectangle is inside the previous key --> ignored and removed
+			prev = x; 
+			candidates.erase(candidates.begin() + index); 
+			x_centers.erase(x_centers.begin() + index);
+		}
+		else {						// add the key in the sorted list, then removed from the keys list
+			rects.push_back(candidates.at(index));
+			candidates.erase(candidates.begin() + index);
+			x_centers.erase(x_centers.begin() + index);
+			prev = x;
+		}
+	}
+}
+
+void prepareKeysContours(Mat src, const vector<RotatedRect> &rects, vector<Mat> &keys) {
+	keys.clear();
+	// grayscale license plate image
+	Mat gray;
+	cvtColor(src, gray, CV_BGR2GRAY);
+	double light = mean(gray)[0];	// average pixel value, the threshold of the keys
+
+	// padding values
+	int pad = (int) (0.3*28);
+
+	// crop each key from the color plate, then threshold, resize and pad it
+	for (size_t i = 0; i < rects.size(); i++) {
+		Mat temp;
+		crop(src, temp, rects[i], 1);
+		cvtColor(temp, temp, CV_BGR2GRAY);
+		threshold(temp, temp, light, 255, THRESH_BINARY);
+		resize(temp, temp, Size(28,28));
+		Mat inverted = ~temp;
+		copyMakeBorder( inverted, inverted, pad, pad, pad, pad, BORDER_CONSTANT, 0 );
+		resize(inverted, inverted, Size(28,28));
+		keys.push_back(inverted);
+	}
+}
+
+int keysRegression(const TraceReader &reader) {
+	int checked = 0;	// frames with a refined plate
+	int failed = 0;		// frames with different keys
+	for (int i = 0; i < reader.frames(); i++) {
+		const TraceFrame &frame = reader.frame(i);
+		if (frame.refined_img.rows < 1) { continue; }
+		checked++;
+
+		vector<RotatedRect> rects, contour_rects;
+		vector<Mat> keys, contour_keys;
+		segmentKeys(frame.refined_img, rects);
+		prepareKeys(frame.refined_img, rects, keys);
+		segmentKeysContours(frame.refined_img, contour_rects);
+		prepareKeysContours(frame.refined_img, contour_rects, contour_keys);
+
+		// same number of keys and each pair of keys with the same rect and the same processed image
+		bool same = keys.size() == contour_keys.size();
+		double max_difference = 0;	// largest mean absolute difference between two keys
+		for (size_t k = 0; same && k < keys.size(); k++) {
+			Point2f d = rects[k].center - contour_rects[k].center;
+			if (fabs(d.x) > KEYS_MAX_OFFSET || fabs(d.y) > KEYS_MAX_OFFSET) { same = false; }
+			// the sides are compared regardless of the angle: the same rect can be described by (w, h, a) and (h, w, a+90)
+			Size2f a = rects[k].size;
+			Size2f b = contour_rects[k].size;
+			if (fabs(min(a.width, a.height) - min(b.width, b.height)) > KEYS_MAX_OFFSET) { same = false; }
+			if (fabs(max(a.width, a.height) - max(b.width, b.height)) > KEYS_MAX_OFFSET) { same = false; }
+			double difference = norm(keys[k], contour_keys[k], NORM_L1) / keys[k].total();
+			max_difference = max(max_difference, difference);
+			if (difference > KEYS_MAX_DIFFERENCE) { same = false; }
+		}
+
+		if (!same) {
+			failed++;
+			cout << i << ": " << frame.src_path << ": " << rects.size() << " keys, " << contour_rects.size() << " with contours";
+			if (keys.size() == contour_keys.size()) {
+				cout << ", largest difference between the key images " << max_difference;
+			}
+			cout << endl;
+			for (size_t k = 0; k < rects.size(); k++) {
+				cout << "\tkey " << k << ": center " << rects[k].center << ", size " << rects[k].size << ", angle " << rects[k].angle << endl;
+			}
+			for (size_t k = 0; k < contour_rects.size(); k++) {
+				cout << "\tcontour key " << k << ": center " << contour_rects[k].center << ", size " << contour_rects[k].size << ", angle " << contour_rects[k].angle << endl;
+			}
+		}
+	}
+	cout << checked << " plates checked, " << failed << " with different keys." << endl;
+	return failed;
+}
@@ -0,0 +1,58 @@
+// g++ -O2 SpanBenchmark.cpp -o SpanBenchmark
+
+#include <iostream>
+#include <cstdlib>
+#include "spans.hpp"
+
+using namespace std;
+
+// maximum cost of a span when tracing is disabled, in nanoseconds: above it the benchmark fails
+#define SPAN_MAX_DISABLED_OVERHEAD 5.0
+
+// the work traced by the benchmark: small enough to make the cost of a span visible
+// noinline: the compiler must not merge the calls of the loops
+__attribute__((noinline)) int64_t work(int64_t i) {
+	return i * 2654435761LL ^ (i >> 3);
+}
+
+__attribute__((noinline)) int64_t tracedWork(int64_t i) {
+	TRACE_SPAN("work");
+	return i * 2654435761LL ^ (i >> 3);
+}
+
+// nanoseconds per call of f over the given number of iterations
+double measure(int64_t (*f)(int64_t), int64_t iterations) {
+	volatile int64_t sink = 0;	// keeps the results alive
+	int64_t start = spanNow();
+	for (int64_t i = 0; i < iterations; i++) {
+		sink += f(i);
+	}
+	return (double) (spanNow() - start) / iterations;
+}
+
+// main function
+// usage: ./SpanBenchmark [iterations] [max disabled overhead, ns]
+// prints the cost of a span with tracing disabled and enabled, compared with the same call without any span
+// exit status 1 if the overhead of a disabled span is above the maximum (SPAN_MAX_DISABLED_OVERHEAD by default)
+int main(int argc, char** argv) {
+	int64_t iterations = argc > 1 ? atoll(argv[1]) : 50000000;
+	double max_overhead = argc > 2 ? atof(argv[2]) : SPAN_MAX_DISABLED_OVERHEAD;
+
+	measure(work, iterations/10);		// warm up
+	double plain = measure(work, iterations);
+	double disabled = measure(tracedWork, iterations);
+
+	spansStart("/dev/null");	// record the events, without producing a file
+	double enabled = measure(tracedWork, iterations);
+
+	cout << "no span:          " << plain << " ns/call" << endl;
+	cout << "span, disabled:   " << disabled << " ns/call (overhead " << disabled - plain << " ns)" << endl;
+	cout << "span, enabled:    " << enabled << " ns/call (overhead " << enabled - plain << " ns)" << endl;
+
+	if (disabled - plain > max_overhead) {
+		cout << "FAILED: a disabled span costs more than " << max_overhead << " ns." << endl;
+		return 1;
+	}
+	cout << "OK: a disabled span costs less than " << max_overhead << " ns." << endl;
+	return 0;
+}
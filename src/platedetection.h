@@ -0,0 +1,72 @@
+#ifndef PLATE_DETECTION_H
+#define PLATE_DETECTION_H
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+
+// the plate detectors look for candidates on a level of the image pyramid whose width is larger than
+// PYRAMID_BASE_WIDTH and at most 2*PYRAMID_BASE_WIDTH: their size filters are tuned for images of this size
+#define PYRAMID_BASE_WIDTH 640
+
+// compute the level of the image pyramid on which the plate candidates are searched:
+// src is halved until its width is at most 2*PYRAMID_BASE_WIDTH (images up to that width are used as they are)
+// returns the scale of the level with respect to src (1, 0.5, 0.25, ...)
+double getPyramidLevel(cv::Mat src, cv::Mat &level);
+
+// scale the center and the size of a rect (e.g. to map it between pyramid levels)
+cv::RotatedRect scaleRect(cv::RotatedRect rect, double factor);
+
+// map a rect found on a pyramid level of the given scale back to src,
+// then refine it looking for the plate contour inside a small window of src around it
+cv::RotatedRect refineAtFullResolution(cv::Mat src, cv::RotatedRect rect, double scale);
+
+// detect the license plate in the source image; gray is the grayscale version of src
+// if candidates is not NULL, every rectangle which passes the size filters is stored inside it
+// returns true if the plate is found; dst is cropped from src only if src is not empty (cropped_plate is always set)
+bool getFirstCut(cv::Mat src, cv::Mat gray, cv::Mat &dst, cv::RotatedRect &cropped_plate, std::vector<cv::RotatedRect> *candidates = NULL);
+
+// true if cancel is not NULL and it has been set
+bool isCancelled(const std::atomic<bool> *cancel);
+
+// if not found with the getFirstCut function, apply a different method to detect the license plate; gray is the grayscale version of src
+// if candidates is not NULL, every rectangle which passes the size filters is stored inside it
+// if cancel is set while running (e.g. by another thread), it returns as soon as possible without a plate
+// returns true if the plate is found; dst is cropped from src only if src is not empty (cropped_plate is always set)
+bool getAlternativeFirstCut(cv::Mat src, cv::Mat gray, cv::Mat &dst, cv::RotatedRect &cropped_plate, std::vector<cv::RotatedRect> *candidates = NULL, const std::atomic<bool> *cancel = NULL);
+
+// axis-aligned box around rect, with the sides of rect, inside an image of the given size
+// (the box of each candidate of getAlternativeFirstCut)
+cv::Rect plateBox(cv::RotatedRect rect, cv::Size size);
+
+// box cropped by getAlternativeFirstCut around the plate rect found inside an image of the given size:
+// the plateBox widened by 12 pixels; if scale < 1 (the image is a pyramid level) the box is mapped back to src
+// (it can exceed src by a pixel: to be clipped by the caller)
+cv::Rect alternativeCropBox(cv::RotatedRect rect, cv::Size size, double scale = 1);
+
+// refine the previously found license plate, removing noise
+void refineCut(cv::Mat src, cv::Mat &dst);
+
+// find the rects of the license plate keys, sorted from left to right
+// a single connected components pass on the thresholded plate: the keys are filtered using the min area rect of each component,
+// grown by one pixel on each side (the contours of the keys used to run along the light pixels around them)
+void segmentKeys(cv::Mat src, std::vector<cv::RotatedRect> &rects);
+
+// crop the keys found by segmentKeys from the plate and process them as the CNN expects them (28x28, white on black)
+// the keys share a single contiguous buffer, one key after the other; keys is left empty if rects is empty
+void prepareKeys(cv::Mat src, const std::vector<cv::RotatedRect> &rects, std::vector<cv::Mat> &keys);
+
+// find the license plate keys, sorted from left to right and processed as the CNN expects them (28x28, white on black)
+// the keys share a single contiguous buffer, one key after the other; keys is left empty if no key is found
+void findKeys(cv::Mat src, std::vector<cv::Mat> &keys);
+
+// crop function (only the part of src around rect is rotated):
+// mode 0: crop the specified area, considering the largest side as the width
+// mode 1: crop the specified area, considering the largest side as the height
+void crop(cv::Mat src, cv::Mat &crop, cv::RotatedRect rect, int mode);
+
+#endif // PLATE_DETECTION_H
@@ -0,0 +1,532 @@
+#include "platedetection.h"
+#include "spans.hpp"
+
+using namespace cv;
+using namespace std;
+
+double getPyramidLevel(Mat src, Mat &level) {
+	TRACE_SPAN("getPyramidLevel");
+	// number of times the image needs to be halved
+	int factor = 1;
+	while (src.cols/factor > 2*PYRAMID_BASE_WIDTH) {
+		factor *= 2;
+	}
+	if (factor == 1) {
+		level = src;
+		return 1;
+	}
+	// src is cropped to a multiple of factor (at most factor-1 pixels lost on the right and bottom borders):
+	// each halving is then an exact 2x2 average (INTER_AREA), several times faster than a single resize
+	// with a fractional ratio, and the level maps back to src exactly with the returned scale
+	level = src(Rect(0, 0, src.cols/factor*factor, src.rows/factor*factor));
+	for (int f = factor; f > 1; f /= 2) {
+		resize(level, level, Size(level.cols/2, level.rows/2), 0, 0, INTER_AREA);
+	}
+	return 1.0/factor;
+}
+
+RotatedRect scaleRect(RotatedRect rect, double factor) {
+	return RotatedRect(rect.center*factor, Size2f(rect.size.width*factor, rect.size.height*factor), rect.angle);
+}
+
+RotatedRect refineAtFullResolution(Mat src, RotatedRect rect, double scale) {
+	TRACE_SPAN("refineAtFullResolution");
+	RotatedRect mapped = scaleRect(rect, 1/scale);
+	if (scale >= 1) {	// the rect was already found at full resolution
+		return mapped;
+	}
+
+	// sides of the mapped rect, with width larger than height
+	float width = max(mapped.size.width, mapped.size.height);
+	float height = min(mapped.size.width, mapped.size.height);
+
+	// window around the mapped rect: a pixel of the level is 1/scale pixels of src, so the margin covers
+	// the error of the mapping plus half of the plate height
+	int margin = (int) (height/2 + 2/scale);
+	Rect window = mapped.boundingRect();
+	window = Rect(window.x-margin, window.y-margin, window.width+2*margin, window.height+2*margin) & Rect(0, 0, src.cols, src.rows);
+	if (window.width < 1 || window.height < 1) {
+		return mapped;
+	}
+
+	// binary image of the window: Otsu's threshold, the window contains mostly the plate and its border
+	Mat gray;
+	cvtColor(src(window), gray, CV_BGR2GRAY);
+	threshold(gray, gray, 0, 255, THRESH_BINARY | THRESH_OTSU);
+
+	vector<vector<Point> > contours;
+	vector<Vec4i> hierarchy;
+	findContours(gray, contours, hierarchy, RETR_LIST, CHAIN_APPROX_SIMPLE);	// RETR_LIST -> no hierarchy needed, only the plate border is searched
+	TRACE_COUNTER("refineAtFullResolution contours", contours.size());
+
+	// keep the contour whose rect is the closest to the mapped one: same center and sides, within a quarter of the plate height
+	Point2f center = mapped.center - Point2f(window.x, window.y);	// center of the mapped rect inside the window
+	float tolerance = height/4;
+	float best_score = -1;
+	RotatedRect best = mapped;
+	for (size_t i = 0; i < contours.size(); i++) {
+		RotatedRect r = minAreaRect( Mat(contours[i]) );
+		float w = max(r.size.width, r.size.height);
+		float h = min(r.size.width, r.size.height);
+		Point2f d = r.center - center;
+		float dist = sqrt(d.x*d.x + d.y*d.y);
+		if (dist > tolerance || fabs(w-width) > 2*tolerance || fabs(h-height) > tolerance) {
+			continue;
+		}
+		float score = dist + fabs(w-width) + fabs(h-height);
+		if (best_score < 0 || score < best_score) {
+			best_score = score;
+			best = r;
+			best.center += Point2f(window.x, window.y);	// back to src coordinates
+		}
+	}
+	return best;
+}
+
+bool getFirstCut(Mat src, Mat gray, Mat &dst, RotatedRect &cropped_plate, vector<RotatedRect> *candidates) {
+	TRACE_SPAN("getFirstCut");
+
+	// apply a median filter to the grayscale image
+	// median filter --> preserves edges while removing noise
+	Mat median;
+	medianBlur(gray, median, 1);
+
+	// threshold to have binary image
+	adaptiveThreshold(median, median, 255, CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY, 55, 5);
+
+	// apply open morphological operator to further remove noise
+	// open --> erode followed by dilate
+	Mat element = getStructuringElement( MORPH_RECT, Size(2, 2));
+	morphologyEx(median, median, MORPH_OPEN, element);
+
+	// finding contours and rectangles around it
+	vector<vector<Point> > contours;	// store contours found
+	vector<Vec4i> hierarchy;			// store hierarchies of contours
+	findContours(median, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE); 	// RETR_TREE -> retrieves all the contours and creates a full family hierarchy list
+																				// CHAIN_APPROX_SIMPLE -> saving only the corners of the contours
+	TRACE_COUNTER("getFirstCut contours", contours.size());
+
+	// min rectangles around contours
+	vector<RotatedRect> minRect( contours.size() );
+	for( int i = 0; i < contours.size(); i++ ) { 
+	 	minRect[i] = minAreaRect( Mat(contours[i]) );
+	}
+
+	int passed = 0;		// number of rectangles which passed the size filters
+
+	// iterate through the contours
+	for( int i = 0; i < contours.size(); i++ ) {
+
+		// this code needs to fix the angle problem of the rectangles
+		float height = minRect[i].size.height;
+		float width = minRect[i].size.width;
+		float angle = minRect[i].angle;
+		// we need rectangles with width larger than height --> searching license plates
+		if (height > width) {	// switch sizes if height > width
+			float temp = width;
+			width = height;
+			height = temp;
+		} 
+		float ratio = width/height; // useful to detect the right rectangle containing the license plate
+		
+		// the following if statement filters out lots of rectangles --> rectangles which cannot be licence plates
+		if (ratio > 1.8 && ratio < 6 && height > 20 && width > 90 && height < 90) {	
+   			if (candidates != NULL) { candidates->push_back(minRect[i]); }
+   			passed++;
+   		
+	   		int counter = 0;			// number of "key" rectangles found inside the current rectangle
+	   		int k = hierarchy[i][2];	// searching through the children of the current rectangle
+	   		if (k > 0) {				// current rectangle has children (at least 1 child)
+	   			do {
+	   				Rect rex = boundingRect(contours.at(k));	// rectangle bounding a contour
+	   				// the following if statement filters out rectangles which cannot be plate keys
+	   				if (rex.width > 10 && rex.height > 10 && (float)rex.width/rex.height < 0.75 && (float)rex.width/rex.height > 0.3) {
+	   					counter++;
+	   				}
+	   				k = hierarchy[k][0]; // next rectangle in the same layes
+	   			} while (k>0);
+	   		}
+	   		if (counter > 4) {	// requirement: a license plate has at least 5 plate keys
+	   			cropped_plate = minRect[i];
+				if (!src.empty()) {
+					crop(src, dst, minRect[i], 0);
+				}
+				TRACE_COUNTER("getFirstCut candidates", passed);
+				// it is not needed to go further --> it is unlikely this is not the license plate
+				return true;
+	   		}
+	   	} 
+	}
+	TRACE_COUNTER("getFirstCut candidates", passed);
+	return false;
+}
+
+bool isCancelled(const atomic<bool> *cancel) {
+	return cancel != NULL && cancel->load(memory_order_relaxed);
+}
+
+bool getAlternativeFirstCut(Mat src, Mat gray, Mat &dst, RotatedRect &cropped_plate, vector<RotatedRect> *candidates, const atomic<bool> *cancel) {
+	TRACE_SPAN("getAlternativeFirstCut");
+
+	// filtered grayscale image
+	// using gaussian blur filter --> to reduce noise 
+	Mat gaussian;
+	GaussianBlur( gray, gaussian, Size(5, 5), 0);
+	if (isCancelled(cancel)) { return false; }	// checked between the steps: the result is not needed anymore
+
+	// filtering using sobel filter to emphasize edges
+	// in this case: sobel used to detect vertical edges.
+	Mat sobel;
+	Sobel( gaussian, sobel, -1, 1, 0 );
+
+	// threshold to have binary image
+	threshold(sobel, sobel, 80, 255, THRESH_BINARY);
+	if (isCancelled(cancel)) { return false; }
+
+	// applying morpological operator close --> to better define the plate zone
+	// close: first dilate then erode
+	// useful to close small holes inside the objects
+	Mat morph;
+	Mat element = getStructuringElement( MORPH_RECT, Size(16, 16));
+	morphologyEx(sobel, morph, MORPH_CLOSE, element);
+	if (isCancelled(cancel)) { return false; }
+
+	// finding contours and rectangles around them
+	vector<vector<Point> > contours;	// store contours found
+	vector<Vec4i> hierarchy;			// store hierarchies of contours
+	findContours(morph, contours, hierarchy, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);	// RETR_EXTERNAL ->  all child contours left behind
+																					// CHAIN_APPROX_SIMPLE -> saving only the corners of the contours
+	TRACE_COUNTER("getAlternativeFirstCut contours", contours.size());
+	// min rectangle around contours
+	vector<RotatedRect> minRect( contours.size() );	
+	for( int i = 0; i < contours.size(); i++ ) { 
+		minRect[i] = minAreaRect( Mat(contours[i]) );
+	}
+
+	int index = -1;				// index of the candidate rectangle
+	float edge_density = 0;		// to filter out all the noise given by rectangles which are not the license plate
+	int passed = 0;				// number of rectangles which passed the size filters
+	
+	for( int i = 0; i < contours.size(); i++ ) {	// iterate through the contours
+		if (isCancelled(cancel)) { return false; }
+		// this code needs to fix the angle problem of the rects
+		float height = minRect[i].size.height;
+		float width = minRect[i].size.width;
+		// we need rectangles with width larger than height --> searching license plates
+		if (height > width) {	// switch sizes if height > width
+			float temp = width;
+			width = height;
+			height = temp;
+		} 
+		float ratio = width/height; // useful to detect the right rectangle containing the license plate
+
+		Point2f center = minRect[i].center;		// center of the rectangle
+		
+		// the following if statement filters out lots of rectangles --> rectangles which cannot be licence plates
+		if ((ratio < 1.5 || ratio > 5 || width < 30 || height < 16)) {
+			// skip
+	   	} else {
+	   		if (candidates != NULL) { candidates->push_back(minRect[i]); }
+	   		passed++;
+	   		// rotated rectangle
+			Point2f rect_points[4]; 
+			minRect[i].points( rect_points );
+	   		// building roi to crop
+	   		if (width < 1 || height < 1) {continue;}
+	   		Rect roi = plateBox(minRect[i], gray.size());
+
+	   		// compute the edge_density (white pixels) inside each rect which survived so far
+	   		Mat crop = morph(roi);
+	   		int white = 0;		// number of white pixels
+	   		int count = 0;		// total number of pixels
+	   		for (int k = 0; k < crop.rows; k++) {
+	   			for (int m = 0; m < crop.cols; m++) {
+	   				if (crop.at<uchar>(k,m) > 250) { white++; }
+	   				count++;
+	   			}
+	   		}
+
+	   		// edge density of the current rectangle
+	   		float density = (float)white/count;	
+
+	   		// keeping only one rect: the one with the highest density
+	   		if (density > edge_density) {
+	   			edge_density = density;	// max density so far
+	   			index = i;				// updating the index of the candidate
+	   		} 
+	  	}
+	}
+
+	TRACE_COUNTER("getAlternativeFirstCut candidates", passed);
+
+	// no rectangle passed the filters --> no license plate
+	if (index < 0) {
+		return false;
+	}
+
+	// crop the src image, based on the roi of the candidate (widened, see alternativeCropBox)
+	if (!src.empty()) {
+		dst = src(alternativeCropBox(minRect[index], gray.size()));
+	}
+	// min rectangle containing the license plate
+	cropped_plate = minRect[index];
+	return true;
+}
+
+Rect plateBox(RotatedRect rect, Size size) {
+	float width = max(rect.size.width, rect.size.height);
+	float height = min(rect.size.width, rect.size.height);
+	Rect roi;
+	roi.x = rect.center.x-width/2;
+	if (roi.x < 0) { roi.x = 0; }	// check if roi is inside the image
+	roi.y = rect.center.y-height/2;
+	if (roi.y < 0) { roi.y = 0; }	// check if roi is inside the image
+	if (roi.x + width > size.width) { roi.width = size.width-roi.x; }	// check if roi is inside the image
+	else { roi.width = width; }
+	if (roi.y + height > size.height) { roi.height = size.height-roi.y; }	// check if roi is inside the image
+	else { roi.height = height; }
+	return roi;
+}
+
+Rect alternativeCropBox(RotatedRect rect, Size size, double scale) {
+	Rect box = plateBox(rect, size);
+	// increasing the width a bit (12 pixels), in order to be sure to have the license plate
+	// it will be refined later
+	box.width += 12;
+	box &= Rect(0, 0, size.width, size.height);	// check if roi is inside the image
+	if (scale >= 1) {
+		return box;
+	}
+	// same box on src: a pixel of the level is 1/scale pixels of src
+	return Rect(cvFloor(box.x/scale), cvFloor(box.y/scale), cvCeil(box.width/scale), cvCeil(box.height/scale));
+}
+
+void refineCut(Mat src, Mat &dst) {
+	TRACE_SPAN("refineCut");
+	// clone the src, we do not want the source to change
+	Mat plate = src.clone();
+	cvtColor(plate, plate, CV_BGR2GRAY);	// plate in grayscale
+
+	// threshold the grayscale image to get binary image
+	adaptiveThreshold(plate, plate, 255, CV_ADAPTIVE_THRESH_GAUSSIAN_C, CV_THRESH_BINARY, 55, 5);
+
+	// getting contours of the cropped images
+	vector<vector<Point>> contours;
+	vector<Vec4i> hierarchy;
+	// find contours of cropped image
+	findContours(plate, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE);	// RETR_TREE -> retrieves all the contours and creates a full family hierarchy list
+																				// CHAIN_APPROX_SIMPLE -> saving only the corners of the contours
+	vector<RotatedRect> rects( contours.size() );	// rectangles around contours
+
+	// find the rect with the biggest dimensions --> in order to crop better the license plate --> further remove noise
+	double max_wid = 0;		// max width of rects
+	double max_hei = 0;		// max height of rects
+	int ind = 0;			// index of biggest rect
+	for( int i = 0; i < contours.size(); i++ ) { 
+	 	rects[i] = minAreaRect( Mat(contours[i]));		// get min area rect around contours
+	 	Point2f pts[4]; 
+	 	rects[i].points( pts );			// points of the rect
+
+		// compute max width and height
+		Size s = rects[i].size;
+		double wid = s.width;			// current width
+		double hei = s.height;			// current height
+		if (hei > wid) {				// fixing the angle problem of rects --> we need width > height
+			float temp = wid;
+			wid = hei;
+			hei = temp;
+		} 
+		// update the index of the biggest square
+		if (wid >= max_wid && hei >= max_hei && hei > 20) {
+			max_wid = wid;
+			max_hei = hei;
+			ind = i;
+		}
+	}
+	
+	// cropping the license plate with better precision, reducing noise
+	crop(src, dst, rects[ind], 0);
+}
+
+void segmentKeys(Mat src, vector<RotatedRect> &rects) {
+	TRACE_SPAN("segmentKeys");
+	// grayscale plate
+	Mat binary;
+	cvtColor(src, binary, CV_BGR2GRAY);
+
+	// threshold to get binary image of plate
+	// THRESH_BINARY_INV --> the keys (dark on the plate) become the foreground
+	adaptiveThreshold(binary, binary, 255, CV_ADAPTIVE_THRESH_GAUSSIAN_C, THRESH_BINARY_INV, 55, 5);
+
+	// label the keys in a single pass: the bounding box of each component is in its stats
+	// connectivity 4: findContours joins the light pixels of the plate with connectivity 8,
+	// so the dark regions it used to find inside them are 4-connected
+	Mat labels, stats, centroids;
+	int components = connectedComponentsWithStats(binary, labels, stats, centroids, 4, CV_32S);
+	TRACE_COUNTER("segmentKeys components", components-1);
+
+	vector<RotatedRect> candidates;	// rects which passed the filters
+	vector<Rect> candidate_boxes;	// and their bounding boxes
+	for (int i = 1; i < components; i++) {	// label 0 is the background
+		Rect box(stats.at<int>(i, CC_STAT_LEFT), stats.at<int>(i, CC_STAT_TOP), stats.at<int>(i, CC_STAT_WIDTH), stats.at<int>(i, CC_STAT_HEIGHT));
+
+		// the rect below is inside the box grown by one pixel on each side, so it is shorter than its diagonal --> too small to be a key
+		if ((box.width+2)*(box.width+2) + (box.height+2)*(box.height+2) <= 75*75) {continue;}
+
+		// min area rect around the component grown by one pixel towards its 4 neighbours: the keys can be rotated
+		// findContours ran along the light pixels around the key, so this is the rect the contour based segmentation found
+		// (only the vertices of the hull of the pixels need to be moved: the rest is inside the grown hull anyway)
+		vector<Point> pixels, hull, grown;
+		findNonZero(labels(box) == i, pixels);
+		convexHull(pixels, hull);
+		for (size_t k = 0; k < hull.size(); k++) {
+			grown.push_back(hull[k] + Point(1, 0));
+			grown.push_back(hull[k] + Point(-1, 0));
+			grown.push_back(hull[k] + Point(0, 1));
+			grown.push_back(hull[k] + Point(0, -1));
+		}
+		RotatedRect rect = minAreaRect(grown);
+		rect.center += Point2f(box.x, box.y);
+
+		// in this case we want rectangles to have larger height than width
+		Size size = rect.size;
+		if (size.width > size.height) {
+			size = Size(size.height, size.width);
+		}
+		float ratio = (float)size.height/size.width;	// useful information to detect keys of the current rectangle
+
+		// same filters used by the contour based segmentation
+		if (size.width <= 25 || size.height <= 75 || size.height > 180) {continue;}
+		if (ratio < 1.25 || ratio > 4.4) {continue;}
+		candidates.push_back(rect);
+		candidate_boxes.push_back(box);
+	}
+
+	// sort the keys from left to right by the x coord of their centers
+	vector<int> order(candidates.size());
+	for (size_t i = 0; i < order.size(); i++) { order[i] = i; }
+	sort(order.begin(), order.end(), [&](int a, int b) { return candidates[a].center.x < candidates[b].center.x; });
+
+	// remove duplicates: rects too close to the previous one or inside a key already found
+	rects.clear();
+	vector<Rect> boxes;		// bounding boxes of the keys found
+	double prev = 0;		// x coord of the center of the previous rect
+	for (size_t i = 0; i < order.size(); i++) {
+		const RotatedRect &rect = candidates[order[i]];
+		const Rect &box = candidate_boxes[order[i]];
+		double x = rect.center.x;
+		bool nested = false;
+		for (size_t k = 0; k < boxes.size(); k++) {
+			if ((box & boxes[k]) == box) { nested = true; }
+		}
+		if (i != 0 && (x < prev+5 || nested)) {	// this rectangle is inside the previous key --> ignored
+			prev = x;
+			continue;
+		}
+		rects.push_back(rect);
+		boxes.push_back(box);
+		prev = x;
+	}
+}
+
+void prepareKeys(Mat src, const vector<RotatedRect> &rects, vector<Mat> &keys) {
+	TRACE_SPAN("prepareKeys");
+	// if no keys were found --> nothing to process
+	keys.clear();
+	if (rects.size() < 1) {
+		return;
+	}
+
+	// grayscale license plate image
+	Mat gray;
+	cvtColor(src, gray, CV_BGR2GRAY);	
+	double light = 0;	// average pixel value
+	int counter = 0;	// number of pixels
+	// summing up all pixel values of the grayscale license plate and then divide by the total number of pixel
+	// --> to get best possibile value for thresholding
+	for (int i = 0; i < gray.cols; i++) {
+		for (int j = 0; j < gray.rows; j++) {
+			counter++;
+			light += gray.at<uchar>(j,i);
+		}
+	}
+	light /= counter;
+
+	// padding values
+	int top = (int) (0.3*28); 
+	int bottom = (int) (0.3*28);
+	int left = (int) (0.3*28); 
+	int right = (int) (0.3*28);
+
+	// the keys are stored in a single contiguous batch: key i is made of the rows from 28*i to 28*(i+1)
+	Mat batch(28*rects.size(), 28, CV_8UC1);
+
+	// processing of keys
+	// cropping (straightened), thresholding, resizing and padding the keys --> to better resemble the dataset used to train the CNN
+	for (size_t i = 0; i < rects.size(); i++) {
+		Mat temp;
+		crop(src, temp, rects[i], 1);
+		cvtColor(temp, temp, CV_BGR2GRAY);
+		threshold(temp, temp, light, 255, THRESH_BINARY); 
+		resize(temp, temp, Size(28,28));
+		Mat inverted = ~temp;
+		copyMakeBorder( inverted, inverted, top, bottom, left, right, BORDER_CONSTANT, 0 );
+
+		// Mat element = getStructuringElement( MORPH_RECT, Size(2,2));
+		// erode(inverted, inverted, element);
+
+		Mat key = batch.rowRange(28*i, 28*(i+1));
+		resize(inverted, key, Size(28,28));	// written in place: key already has the right size and type
+		keys.push_back(key);
+	}
+}
+
+void findKeys(Mat src, vector<Mat> &keys) {
+	TRACE_SPAN("findKeys");
+	// rects of the keys, sorted from left to right
+	vector<RotatedRect> rects;
+	segmentKeys(src, rects);
+	prepareKeys(src, rects, keys);
+	TRACE_COUNTER("keys found", keys.size());
+}
+
+void crop(Mat src, Mat &crop, RotatedRect rect, int mode) {
+	TRACE_SPAN("crop");
+	// get center, angle and size of rect
+	Point2f center = rect.center;
+	double angle = rect.angle;
+	Size size = rect.size;
+	if (mode == 0) {
+		// we need width > height
+		if (size.height > size.width) {
+			angle += 90;
+			size = Size(size.height, size.width);
+		}
+	} else if (mode == 1) {
+		// we need height > width
+		if (size.width > size.height) {
+			angle += 90;
+			size = Size(size.height, size.width);
+		}
+	} else {	// wrong mode
+		cout << "Wrong 'mode' crop paramter" << endl;
+		cout << "Exiting..." << endl;
+		exit(1);
+	}
+
+	// only the square around rect whose side is its diagonal is rotated: it contains rect at any angle
+	// --> the cost depends on the size of rect, not on the size of src
+	float diagonal = sqrt((float) size.width*size.width + (float) size.height*size.height) + 2;
+	Rect window = Rect(cvFloor(center.x - diagonal/2), cvFloor(center.y - diagonal/2), cvCeil(diagonal) + 1, cvCeil(diagonal) + 1) & Rect(0, 0, src.cols, src.rows);
+	if (window.width < 1 || window.height < 1) {	// rect outside of src: rotate the whole image
+		window = Rect(0, 0, src.cols, src.rows);
+	}
+	Point2f local = center - Point2f(window.x, window.y);	// center of rect inside the window
+
+	// compute rotation matrix
+	Mat m = getRotationMatrix2D(local, angle, 1);
+	// apply affine transformation
+	warpAffine(src(window), crop, m, window.size());
+	// retrieve rectangle from an image with sub-pixel accuracy
+	getRectSubPix(crop, size, local, crop);
+}
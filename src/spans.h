@@ -0,0 +1,74 @@
+#ifndef SPANS_H
+#define SPANS_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Lightweight in-process tracing: scoped spans and counters, exported as Chrome trace JSON
+// (open the file with chrome://tracing or https://ui.perfetto.dev).
+// Every thread writes its events in its own ring buffer, without locks: when a buffer is full
+// the oldest events are overwritten, so a flush exports the last SPANS_BUFFER_SIZE events of each thread.
+// When tracing is disabled a span costs a relaxed atomic load and a branch.
+
+#define SPANS_BUFFER_SIZE 4096		// events kept per thread, must be a power of 2
+
+// a span ('X') or a counter ('C') event
+struct SpanEvent {
+	const char* name;		// must be a string literal: only the pointer is stored
+	int64_t start;			// nanoseconds
+	int64_t value;			// duration in nanoseconds for spans, value for counters
+	char type;
+};
+
+// true when the events are being recorded
+extern std::atomic<bool> spans_enabled;
+
+inline bool spansEnabled() {
+	return spans_enabled.load(std::memory_order_relaxed);
+}
+
+// Enable tracing; the events will be written to json_path by spansFlush()
+// The events are flushed at exit and whenever SIGUSR1 is received (see spansPoll())
+void spansStart(const char* json_path);
+
+// Write the buffered events of every thread to the JSON file given to spansStart()
+void spansFlush();
+
+// Flush the events if SIGUSR1 was received since the last call
+// The signal handler only sets a flag: the file is written here, outside of the handler
+void spansPoll();
+
+// current time in nanoseconds (monotonic clock)
+int64_t spanNow();
+
+// Record a span of the calling thread
+void spanRecord(const char* name, int64_t start, int64_t end);
+
+// Record the value of a counter
+void spanCounter(const char* name, int64_t value);
+
+// Span covering the scope in which it is declared
+class ScopedSpan {
+	public:
+		ScopedSpan(const char* name) : name(name), start(spansEnabled() ? spanNow() : -1) {}
+		~ScopedSpan() {
+			if (start >= 0) {
+				spanRecord(name, start, spanNow());
+			}
+		}
+
+	private:
+		const char* name;
+		int64_t start;		// -1 if tracing was disabled when the span began
+};
+
+#define SPAN_CONCAT_(a, b) a##b
+#define SPAN_CONCAT(a, b) SPAN_CONCAT_(a, b)
+
+// trace the current scope
+#define TRACE_SPAN(name) ScopedSpan SPAN_CONCAT(span_, __LINE__)(name)
+
+// trace the value of a counter
+#define TRACE_COUNTER(name, value) do { if (spansEnabled()) { spanCounter(name, value); } } while (0)
+
+#endif // SPANS_H
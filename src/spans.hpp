@@ -0,0 +1,147 @@
+#include "spans.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+std::atomic<bool> spans_enabled(false);
+
+// ring buffer of a single thread: only its thread writes it, spansFlush() reads it
+struct SpanBuffer {
+	SpanEvent events[SPANS_BUFFER_SIZE];
+	std::atomic<uint64_t> head;		// number of events written so far
+	int tid;
+};
+
+static string spans_path;						// where to write the JSON file
+static mutex spans_mutex;						// protects spans_buffers (registration and flush only)
+static vector<SpanBuffer*> spans_buffers;		// buffers of every thread; never freed, threads may exit before the flush
+static volatile sig_atomic_t spans_flush_requested = 0;
+
+static thread_local SpanBuffer* span_buffer = NULL;
+
+static void spansSignalHandler(int) {
+	spans_flush_requested = 1;
+}
+
+static void spansAtExit() {
+	spansFlush();
+}
+
+// buffer of the calling thread, created and registered on its first event
+static SpanBuffer* spansThreadBuffer() {
+	if (span_buffer == NULL) {
+		SpanBuffer* buffer = new SpanBuffer();
+		buffer->head.store(0, memory_order_relaxed);
+		lock_guard<mutex> lock(spans_mutex);
+		buffer->tid = spans_buffers.size() + 1;
+		spans_buffers.push_back(buffer);
+		span_buffer = buffer;
+	}
+	return span_buffer;
+}
+
+// append an event to the buffer of the calling thread
+static void spansPush(const char* name, int64_t start, int64_t value, char type) {
+	SpanBuffer* buffer = spansThreadBuffer();
+	uint64_t head = buffer->head.load(memory_order_relaxed);
+	SpanEvent &event = buffer->events[head & (SPANS_BUFFER_SIZE - 1)];
+	event.name = name;
+	event.start = start;
+	event.value = value;
+	event.type = type;
+	buffer->head.store(head + 1, memory_order_release);	// publish the event
+}
+
+// Enable tracing; the events will be written to json_path by spansFlush()
+// The events are flushed at exit and whenever SIGUSR1 is received (see spansPoll())
+void spansStart(const char* json_path) {
+	if (json_path == NULL || json_path[0] == '\0') {
+		return;
+	}
+	spans_path = json_path;
+	signal(SIGUSR1, spansSignalHandler);
+	atexit(spansAtExit);
+	spans_enabled.store(true, memory_order_relaxed);
+}
+
+// Write the buffered events of every thread to the JSON file given to spansStart()
+void spansFlush() {
+	if (spans_path.empty()) {
+		return;
+	}
+	FILE* file = fopen(spans_path.c_str(), "w");
+	if (file == NULL) {
+		cout << "Unable to write the trace file " << spans_path << "." << endl;
+		return;
+	}
+	int pid = getpid();
+	bool first = true;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	lock_guard<mutex> lock(spans_mutex);
+	for (size_t b = 0; b < spans_buffers.size(); b++) {
+		SpanBuffer* buffer = spans_buffers[b];
+		// copy the events published so far, then drop the ones the thread overwrote while copying
+		uint64_t end = buffer->head.load(memory_order_acquire);
+		uint64_t begin = end > SPANS_BUFFER_SIZE ? end - SPANS_BUFFER_SIZE : 0;
+		vector<SpanEvent> copy;
+		for (uint64_t i = begin; i < end; i++) {
+			copy.push_back(buffer->events[i & (SPANS_BUFFER_SIZE - 1)]);
+		}
+		// the copies above must complete before head is read again
+		atomic_thread_fence(memory_order_acquire);
+		uint64_t now = buffer->head.load(memory_order_relaxed);
+		// the thread may be writing event 'now' right now: its slot held event now+1-SPANS_BUFFER_SIZE,
+		// so that one may be torn too --> the first safe event is the one after it
+		uint64_t valid = now + 1 > SPANS_BUFFER_SIZE ? now + 1 - SPANS_BUFFER_SIZE : 0;
+		for (uint64_t i = begin; i < end; i++) {
+			if (i < valid) { continue; }
+			const SpanEvent &event = copy[i - begin];
+			fprintf(file, "%s\n", first ? "" : ",");
+			first = false;
+			// chrome trace timestamps are in microseconds
+			if (event.type == 'X') {
+				fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+					event.name, event.start/1000.0, event.value/1000.0, pid, buffer->tid);
+			} else {
+				fprintf(file, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"value\":%lld}}",
+					event.name, event.start/1000.0, pid, buffer->tid, (long long) event.value);
+			}
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+}
+
+// Flush the events if SIGUSR1 was received since the last call
+void spansPoll() {
+	if (spans_flush_requested) {
+		spans_flush_requested = 0;
+		spansFlush();
+	}
+}
+
+// current time in nanoseconds (monotonic clock)
+int64_t spanNow() {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Record a span of the calling thread
+void spanRecord(const char* name, int64_t start, int64_t end) {
+	spansPush(name, start, end - start, 'X');
+}
+
+// Record the value of a counter
+void spanCounter(const char* name, int64_t value) {
+	spansPush(name, spanNow(), value, 'C');
+}
@@ -0,0 +1,157 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Binary trace log of the intermediate results of the pipeline, used to replay single stages offline.
+// The file starts with a TraceFileHeader, followed by a sequence of records: each record is a
+// TraceRecordHeader followed by 'size' bytes of payload, padded to a multiple of 8 bytes.
+// Every header and payload is 8-byte aligned, so the file can be memory-mapped and read in place.
+// A frame starts with a TRACE_FRAME record and owns all the records up to the next TRACE_FRAME.
+// The records of a frame are written to the file with a single write(), holding an exclusive flock():
+// several processes can append to the same log without interleaving their frames.
+
+#define TRACE_MAGIC 0x52504c41	// "ALPR"
+#define TRACE_VERSION 1
+
+// record types
+enum TraceRecordType {
+	TRACE_FRAME = 1,			// payload: path of the source image (not null terminated)
+	TRACE_CANDIDATES = 2,		// tag: stage; payload: array of TraceRect
+	TRACE_PLATE = 3,			// tag: stage which detected the plate; payload: one TraceRect
+	TRACE_IMAGE = 4,			// tag: TraceImageKind; payload: TraceImageHeader followed by the pixels
+	TRACE_TIMING = 5,			// tag: stage; payload: one double, in milliseconds
+	TRACE_PROBABILITIES = 6,	// tag: index of the key; payload: array of float, one per class
+	TRACE_LEVEL_SCALE = 7		// payload: one double, scale of the pyramid level searched by the detectors
+};
+
+// pipeline stages
+enum TraceStage {
+	STAGE_FIRST_CUT = 0,
+	STAGE_ALTERNATIVE_FIRST_CUT,
+	STAGE_REFINE_CUT,
+	STAGE_FIND_KEYS,
+	STAGE_LEVEL,				// pyramid level and its grayscale version, input of the detectors (timing only)
+	STAGE_COUNT
+};
+
+// images stored in the log
+enum TraceImageKind {
+	IMAGE_PLATE = 0,	// resized license plate: input of refineCut
+	IMAGE_REFINED,		// refined license plate: input of findKeys
+	IMAGE_KEY,			// processed key: output of findKeys, input of the CNN
+	IMAGE_LEVEL			// grayscale pyramid level: input of the detectors (only if ALPR_TRACE_INPUT is set)
+};
+
+struct TraceFileHeader {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct TraceRecordHeader {
+	uint32_t type;
+	uint32_t tag;
+	uint64_t size;
+};
+
+struct TraceRect {
+	float cx, cy, width, height, angle;
+};
+
+struct TraceImageHeader {
+	int32_t rows, cols, type, reserved;
+};
+
+// name of the stage, as used on the command line of the Replay tool
+const char* traceStageName(int stage);
+
+// milliseconds elapsed since start (a value returned by cv::getTickCount())
+double elapsedMs(int64 start);
+
+// Appends the intermediate results of each processed image to a trace log
+class TraceRecorder {
+	public:
+		// Constructor
+		// Open the log at the given path, in append mode
+		// If path is NULL or empty the recorder is disabled and every method does nothing
+		TraceRecorder(const char* path);
+
+		// Write the last frame and close the log
+		~TraceRecorder();
+
+		// true if the results are being recorded
+		bool enabled() const;
+
+		// Start a new frame: every following record belongs to it
+		// The frame is kept in memory until endFrame() (or the next beginFrame())
+		void beginFrame(const std::string &src_path);
+
+		// Append the current frame to the log, with a single write()
+		// To be called before exit(): the destructor is not run in that case
+		void endFrame();
+
+		// Record the scale of the pyramid level searched by the detectors and, if not empty, the level itself
+		void level(double scale, const cv::Mat &gray);
+
+		// Record the rectangles which passed the size filters of a detection stage
+		void candidates(int stage, const std::vector<cv::RotatedRect> &rects);
+
+		// Record the license plate rectangle chosen by a detection stage
+		void plate(int stage, const cv::RotatedRect &rect);
+
+		// Record an intermediate image
+		void image(int kind, const cv::Mat &img);
+
+		// Record the time spent in a stage
+		void timing(int stage, double ms);
+
+	private:
+		// append a record header followed by the padded payload to the current frame
+		void write(uint32_t type, uint32_t tag, const void* payload, uint64_t size);
+
+		int fd;								// log opened with O_APPEND, -1 if disabled
+		std::vector<uchar> frame_buffer;	// records of the current frame
+};
+
+// Content of a single frame of the log
+// The images point inside the memory mapping: they are valid as long as the reader exists
+struct TraceFrame {
+	std::string src_path;
+	std::vector<cv::RotatedRect> candidates[STAGE_COUNT];
+	int plate_stage;					// -1 if no plate was detected
+	cv::RotatedRect plate;
+	cv::Mat plate_img;					// empty if not recorded
+	cv::Mat refined_img;				// empty if not recorded
+	cv::Mat level_img;					// empty if not recorded
+	double level_scale;					// 1 if not recorded
+	std::vector<cv::Mat> keys;
+	double timings[STAGE_COUNT];		// -1 if the stage was not run
+	std::vector<std::vector<float> > probabilities;
+};
+
+// Memory-maps a trace log and splits it into frames
+class TraceReader {
+	public:
+		// Constructor
+		// Map the log at the given path and parse its records
+		TraceReader(const char* path);
+
+		// Unmap the log
+		~TraceReader();
+
+		// number of frames inside the log
+		int frames() const;
+
+		// i-th frame of the log
+		const TraceFrame& frame(int i) const;
+
+	private:
+		void* data;
+		size_t length;
+		std::vector<TraceFrame> parsed;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,303 @@
+#include "trace.h"
+
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace cv;
+using namespace std;
+
+// name of the stage, as used on the command line of the Replay tool
+const char* traceStageName(int stage) {
+	switch (stage) {
+		case STAGE_FIRST_CUT: return "first";
+		case STAGE_ALTERNATIVE_FIRST_CUT: return "alternative";
+		case STAGE_REFINE_CUT: return "refine";
+		case STAGE_FIND_KEYS: return "keys";
+		case STAGE_LEVEL: return "level";
+	}
+	return "unknown";
+}
+
+// milliseconds elapsed since start (a value returned by cv::getTickCount())
+double elapsedMs(int64 start) {
+	return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+// padded size of a payload: every record starts 8-byte aligned
+static uint64_t tracePadded(uint64_t size) {
+	return (size + 7) & ~(uint64_t)7;
+}
+
+static TraceRect toTraceRect(const RotatedRect &rect) {
+	TraceRect r = { rect.center.x, rect.center.y, rect.size.width, rect.size.height, rect.angle };
+	return r;
+}
+
+static RotatedRect fromTraceRect(const TraceRect &r) {
+	return RotatedRect(Point2f(r.cx, r.cy), Size2f(r.width, r.height), r.angle);
+}
+
+// true if the payload of a record has the size its type requires (the payload is already known to be inside the mapping)
+static bool validTraceRecord(uint32_t type, uint32_t tag, const uchar* payload, uint64_t size) {
+	switch (type) {
+		case TRACE_CANDIDATES:
+			return tag < STAGE_COUNT && size % sizeof(TraceRect) == 0;
+		case TRACE_PLATE:
+			return tag < STAGE_COUNT && size == sizeof(TraceRect);
+		case TRACE_TIMING:
+			return tag < STAGE_COUNT && size == sizeof(double);
+		case TRACE_LEVEL_SCALE:
+			return size == sizeof(double);
+		case TRACE_PROBABILITIES:
+			return size % sizeof(float) == 0;
+		case TRACE_IMAGE: {
+			if (size < sizeof(TraceImageHeader)) { return false; }
+			const TraceImageHeader* img = (const TraceImageHeader*) payload;
+			// only the plain Mat types: 1 to 4 channels of a known depth
+			if (img->type < 0 || (img->type & ~CV_MAT_TYPE_MASK) != 0 || CV_MAT_DEPTH(img->type) > CV_64F || CV_MAT_CN(img->type) > 4) {
+				return false;
+			}
+			if (img->rows < 0 || img->cols < 0) { return false; }
+			// the pixels must fill the rest of the payload exactly
+			return (uint64_t) img->rows * img->cols * CV_ELEM_SIZE(img->type) == size - sizeof(TraceImageHeader);
+		}
+	}
+	return true;	// TRACE_FRAME and unknown types: any size
+}
+
+// Open the log at the given path, in append mode
+// If path is NULL or empty the recorder is disabled and every method does nothing
+TraceRecorder::TraceRecorder(const char* path) {
+	fd = -1;
+	if (path == NULL || path[0] == '\0') {
+		return;
+	}
+	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (fd < 0) {
+		cout << "Unable to open trace file " << path << ": tracing disabled." << endl;
+	}
+}
+
+// Write the last frame and close the log
+TraceRecorder::~TraceRecorder() {
+	if (fd >= 0) {
+		endFrame();
+		close(fd);
+	}
+}
+
+bool TraceRecorder::enabled() const {
+	return fd >= 0;
+}
+
+// Start a new frame: every following record belongs to it
+void TraceRecorder::beginFrame(const string &src_path) {
+	endFrame();
+	write(TRACE_FRAME, 0, src_path.data(), src_path.size());
+}
+
+// Append the current frame to the log, with a single write()
+void TraceRecorder::endFrame() {
+	if (fd < 0 || frame_buffer.empty()) {
+		return;
+	}
+	// the lock covers the check for a new log too: only one process writes the file header
+	flock(fd, LOCK_EX);
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size == 0) {
+		TraceFileHeader header = { TRACE_MAGIC, TRACE_VERSION };
+		frame_buffer.insert(frame_buffer.begin(), (const uchar*) &header, (const uchar*) &header + sizeof(header));
+	}
+	size_t written = 0;
+	while (written < frame_buffer.size()) {	// a regular file is written completely, unless the disk is full
+		ssize_t n = ::write(fd, &frame_buffer[written], frame_buffer.size() - written);
+		if (n <= 0) {
+			cout << "Unable to write the trace file: frame lost." << endl;
+			break;
+		}
+		written += n;
+	}
+	flock(fd, LOCK_UN);
+	frame_buffer.clear();
+}
+
+// Record the scale of the pyramid level searched by the detectors and, if not empty, the level itself
+void TraceRecorder::level(double scale, const Mat &gray) {
+	write(TRACE_LEVEL_SCALE, 0, &scale, sizeof(scale));
+	if (!gray.empty()) {
+		image(IMAGE_LEVEL, gray);
+	}
+}
+
+// Record the rectangles which passed the size filters of a detection stage
+void TraceRecorder::candidates(int stage, const vector<RotatedRect> &rects) {
+	if (fd < 0) { return; }
+	vector<TraceRect> payload;
+	for (size_t i = 0; i < rects.size(); i++) {
+		payload.push_back(toTraceRect(rects[i]));
+	}
+	write(TRACE_CANDIDATES, stage, payload.empty() ? NULL : &payload[0], payload.size()*sizeof(TraceRect));
+}
+
+// Record the license plate rectangle chosen by a detection stage
+void TraceRecorder::plate(int stage, const RotatedRect &rect) {
+	TraceRect payload = toTraceRect(rect);
+	write(TRACE_PLATE, stage, &payload, sizeof(payload));
+}
+
+// Record an intermediate image
+// The pixels are stored row after row, without padding, so that they can be used in place once mapped
+void TraceRecorder::image(int kind, const Mat &img) {
+	if (fd < 0) { return; }
+	Mat continuous = img.isContinuous() ? img : img.clone();
+	TraceImageHeader header = { continuous.rows, continuous.cols, continuous.type(), 0 };
+	uint64_t pixels = continuous.total()*continuous.elemSize();
+	vector<uchar> payload(sizeof(header) + pixels);
+	memcpy(&payload[0], &header, sizeof(header));
+	if (pixels > 0) {
+		memcpy(&payload[sizeof(header)], continuous.data, pixels);
+	}
+	write(TRACE_IMAGE, kind, &payload[0], payload.size());
+}
+
+// Record the time spent in a stage
+void TraceRecorder::timing(int stage, double ms) {
+	write(TRACE_TIMING, stage, &ms, sizeof(ms));
+}
+
+// append a record header followed by the padded payload to the current frame
+void TraceRecorder::write(uint32_t type, uint32_t tag, const void* payload, uint64_t size) {
+	if (fd < 0) { return; }
+	TraceRecordHeader header = { type, tag, size };
+	frame_buffer.insert(frame_buffer.end(), (const uchar*) &header, (const uchar*) &header + sizeof(header));
+	if (size > 0) {
+		frame_buffer.insert(frame_buffer.end(), (const uchar*) payload, (const uchar*) payload + size);
+	}
+	frame_buffer.resize(frame_buffer.size() + tracePadded(size) - size, 0);
+}
+
+// Map the log at the given path and parse its records
+TraceReader::TraceReader(const char* path) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(TraceFileHeader)) {
+		cout << "Unable to read trace file " << path << "." << endl;
+		cout << "Exiting..." << endl;
+		exit(1);
+	}
+	length = st.st_size;
+	data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);	// copy-on-write: the log on disk is never modified
+	close(fd);	// the mapping stays valid after closing the file
+	if (data == MAP_FAILED) {
+		cout << "Unable to map trace file " << path << "." << endl;
+		cout << "Exiting..." << endl;
+		exit(1);
+	}
+
+	const uchar* base = (const uchar*) data;
+	const TraceFileHeader* file_header = (const TraceFileHeader*) base;
+	if (file_header->magic != TRACE_MAGIC || file_header->version != TRACE_VERSION) {
+		cout << "Not a valid trace file (or unsupported version): " << path << "." << endl;
+		cout << "Exiting..." << endl;
+		exit(1);
+	}
+
+	// walk through the records, stopping at the first one which is not valid
+	// (a corrupt or foreign record must never make the reader go outside the mapping)
+	size_t offset = sizeof(TraceFileHeader);
+	while (offset < length) {
+		if (length - offset < sizeof(TraceRecordHeader)) {
+			cout << "Truncated trace record at byte " << offset << ": ignoring the end of the log." << endl;
+			break;
+		}
+		size_t remaining = length - offset - sizeof(TraceRecordHeader);	// payload bytes available after the header
+		const TraceRecordHeader* header = (const TraceRecordHeader*) (base + offset);
+		const uchar* payload = base + offset + sizeof(TraceRecordHeader);
+		uint64_t size = header->size;
+		// compared before padding: tracePadded() must not overflow
+		if (size > remaining || tracePadded(size) > remaining) {
+			cout << "Truncated trace record at byte " << offset << ": ignoring the end of the log." << endl;
+			break;
+		}
+		if (!validTraceRecord(header->type, header->tag, payload, size)) {
+			cout << "Invalid trace record at byte " << offset << ": ignoring the end of the log." << endl;
+			break;
+		}
+		offset += sizeof(TraceRecordHeader) + tracePadded(size);
+
+		// a new frame begins
+		if (header->type == TRACE_FRAME) {
+			TraceFrame frame;
+			frame.src_path = string((const char*) payload, size);
+			frame.plate_stage = -1;
+			frame.level_scale = 1;
+			for (int i = 0; i < STAGE_COUNT; i++) {
+				frame.timings[i] = -1;
+			}
+			parsed.push_back(frame);
+			continue;
+		}
+		// records before the first frame cannot be assigned to anything
+		if (parsed.empty()) {
+			continue;
+		}
+		TraceFrame &frame = parsed.back();
+
+		switch (header->type) {
+			case TRACE_CANDIDATES: {
+				const TraceRect* rects = (const TraceRect*) payload;
+				for (size_t i = 0; i < size/sizeof(TraceRect); i++) {
+					frame.candidates[header->tag].push_back(fromTraceRect(rects[i]));
+				}
+				break;
+			}
+			case TRACE_PLATE:
+				frame.plate_stage = header->tag;
+				frame.plate = fromTraceRect(*(const TraceRect*) payload);
+				break;
+			case TRACE_IMAGE: {
+				const TraceImageHeader* img = (const TraceImageHeader*) payload;
+				// no copy: the Mat header points directly inside the mapping
+				Mat m(img->rows, img->cols, img->type, (void*) (payload + sizeof(TraceImageHeader)));
+				if (header->tag == IMAGE_PLATE) { frame.plate_img = m; }
+				else if (header->tag == IMAGE_REFINED) { frame.refined_img = m; }
+				else if (header->tag == IMAGE_KEY) { frame.keys.push_back(m); }
+				else if (header->tag == IMAGE_LEVEL) { frame.level_img = m; }
+				break;
+			}
+			case TRACE_TIMING:
+				frame.timings[header->tag] = *(const double*) payload;
+				break;
+			case TRACE_PROBABILITIES: {
+				const float* p = (const float*) payload;
+				frame.probabilities.push_back(vector<float>(p, p + size/sizeof(float)));
+				break;
+			}
+			case TRACE_LEVEL_SCALE:
+				frame.level_scale = *(const double*) payload;
+				break;
+			default:	// unknown record: skipped, newer writers may add types
+				break;
+		}
+	}
+}
+
+// Unmap the log
+TraceReader::~TraceReader() {
+	munmap(data, length);
+}
+
+// number of frames inside the log
+int TraceReader::frames() const {
+	return parsed.size();
+}
+
+// i-th frame of the log
+const TraceFrame& TraceReader::frame(int i) const {
+	return parsed.at(i);
+}